@@ -72,6 +72,7 @@ BEGIN_MESSAGE_MAP(CDesktopRecorderDlg, CDialogEx)
 	ON_BN_CLICKED(IDC_START, &CDesktopRecorderDlg::OnBnClickedStart)
 	ON_BN_CLICKED(IDC_STOP, &CDesktopRecorderDlg::OnBnClickedStop)
 	ON_WM_TIMER()
+	ON_WM_DESTROY()
 END_MESSAGE_MAP()
 
 
@@ -107,6 +108,9 @@ BOOL CDesktopRecorderDlg::OnInitDialog()
 	SetIcon(m_hIcon, FALSE);		// 작은 아이콘을 설정합니다.
 
 	// TODO: 여기에 추가 초기화 작업을 추가합니다.
+	// arm capture and encoder in the background so start does not wait for them
+	m_recorder = new Recorder();
+	m_recorder->prepare_record_async();
 
 	return TRUE;  // 포커스를 컨트롤에 설정하지 않으면 TRUE를 반환합니다.
 }
@@ -166,24 +170,39 @@ void CDesktopRecorderDlg::OnBnClickedStart()
 {
 	frame_count = timer_count = 0;
 	//SetTimer(TIMER_ID_FRAME, 1000 / FPS, NULL);
-	//SetTimer(TIMER_ID_FPS, 1000, NULL);
+	SetTimer(TIMER_ID_FPS, 1000, NULL);
 
-	m_recorder = new Recorder();
-	m_recorder->start_record();
+	if (m_recorder)
+	{
+		m_recorder->start_record();
+	}
 }
 
 
 void CDesktopRecorderDlg::OnBnClickedStop()
 {
 	//KillTimer(TIMER_ID_FRAME);
-	//KillTimer(TIMER_ID_FPS);
+	KillTimer(TIMER_ID_FPS);
 
 	if (m_recorder)
 	{
-		m_recorder->stop_record();
+		// the dialog stays responsive while the output is finalized
+		m_recorder->stop_record_async([](int32_t result, int64_t finalize_us) {
+			TRACE(_T("record finalized (%d), %lld us\n"), result, finalize_us);
+			});
+	}
+}
+
+
+void CDesktopRecorderDlg::OnDestroy()
+{
+	if (m_recorder)
+	{
 		delete m_recorder;
 		m_recorder = NULL;
 	}
+
+	CDialogEx::OnDestroy();
 }
 
 
@@ -197,7 +216,18 @@ void CDesktopRecorderDlg::OnTimer(UINT_PTR nIDEvent)
 
 	case TIMER_ID_FPS:
 		timer_count++;
-		TRACE(_T("FPS : %d (%d / %d)\n"), frame_count / timer_count, frame_count, timer_count);
+		if (m_recorder)
+		{
+			// the slowest stage shows where a workstation falls below real time
+			PipelineSnapshot stats = m_recorder->get_stats();
+			int32_t slowest = 0;
+			for (int32_t i = 1; i < PIPELINE_STAGE_COUNT; i++)
+			{
+				if (stats.stages[i].p99_us > stats.stages[slowest].p99_us) slowest = i;
+			}
+			TRACE(_T("FPS : %.1f, dropped %lld, queue %d, slowest %hs p99 %lld us\n"), stats.fps, stats.dropped_frames,
+				stats.frame_queue_depth, PipelineStats::get_stage_name((PipelineStage)slowest), stats.stages[slowest].p99_us);
+		}
 		break;
 	}
 
@@ -12,6 +12,9 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
 
 #include <d3d11.h>
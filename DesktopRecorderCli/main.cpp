@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <csignal>
+#include <string>
+
+#include "Recorder.h"
+#include "RecorderApi.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+static std::atomic<bool> stop_requested(false);
+
+static void on_signal(int)
+{
+	stop_requested = true;
+}
+
+static void on_log(void*, const char* message)
+{
+	fputs(message, stderr);
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: DesktopRecorderCli [options]\n"
+		"  --display NAME         capture source (default \\\\.\\DISPLAY1), synthetic[:WxH[@mean_ms]][,scroll][,stamp]\n"
+		"                         for generated frames with irregular updates\n"
+		"  --size WxH             encoded size (default display size)\n"
+		"  --fps N                frame rate (default 30)\n"
+		"  --pacer NAME           sleep, precise (default sleep)\n"
+		"  --mode NAME            low-latency, throughput, archival\n"
+		"  --rate-control NAME    abr, crf, capped-crf, cbr\n"
+		"  --bitrate BPS          target bitrate for abr and cbr (default 4000000)\n"
+		"  --crf N                quality for crf and capped-crf (default 23)\n"
+		"  --max-bitrate BPS      cap for capped-crf\n"
+		"  --duration SECONDS     stop after this long, 0 records until Ctrl+C (default 10)\n"
+		"  --output FILE          output file, container by extension (default output.mp4)\n"
+		"  --stats FILE           append a JSON stats line every --stats-interval while recording\n"
+		"  --stats-interval MS    stats line interval (default 1000)\n"
+		"  --trace FILE           write a Chrome trace event timeline of the pipeline threads after stop\n");
+}
+
+int main(int argc, char* argv[])
+{
+	std::string display = "\\\\.\\DISPLAY1";
+	std::string output = "output.mp4";
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t fps = 30;
+	PacerWait pacer_wait = PACER_WAIT_SLEEP;
+	EncoderMode mode = ENCODER_MODE_LOW_LATENCY;
+	RateControl rate_control = RATE_CONTROL_ABR;
+	int32_t bitrate = 4 * 1000 * 1000;
+	int32_t crf = 23;
+	int32_t max_bitrate = 0;
+	int32_t duration = 10;
+	std::string stats_file;
+	int32_t stats_interval_ms = 1000;
+	std::string trace_file;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			return 0;
+		}
+
+		if (!value)
+		{
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			usage();
+			return 2;
+		}
+		i++;
+
+		bool valid = true;
+		if (arg == "--display") display = value;
+		else if (arg == "--output") output = value;
+		else if (arg == "--size") valid = sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+		else if (arg == "--fps") valid = (fps = atoi(value)) > 0;
+		else if (arg == "--pacer") valid = Pacer::parse_wait_name(value, &pacer_wait);
+		else if (arg == "--mode") valid = Encoder::parse_mode_name(value, &mode);
+		else if (arg == "--rate-control") valid = Encoder::parse_rate_control_name(value, &rate_control);
+		else if (arg == "--bitrate") valid = (bitrate = atoi(value)) > 0;
+		else if (arg == "--crf") valid = (crf = atoi(value)) >= 0;
+		else if (arg == "--max-bitrate") valid = (max_bitrate = atoi(value)) > 0;
+		else if (arg == "--duration") valid = (duration = atoi(value)) >= 0;
+		else if (arg == "--stats") stats_file = value;
+		else if (arg == "--stats-interval") valid = (stats_interval_ms = atoi(value)) > 0;
+		else if (arg == "--trace") trace_file = value;
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			usage();
+			return 2;
+		}
+
+		if (!valid)
+		{
+			fprintf(stderr, "invalid value %s for %s\n", value, arg.c_str());
+			return 2;
+		}
+	}
+
+	// core messages go to the console in every build
+	recorder_set_log_callback(on_log, nullptr);
+
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+
+	// display names are plain ASCII device paths
+	std::wstring display_name(display.begin(), display.end());
+
+	Recorder* recorder = new Recorder();
+	recorder->set_keep_warm(false);
+	recorder->set_display(display_name.c_str());
+	recorder->set_output(output.c_str());
+	recorder->set_output_size(width, height);
+	recorder->set_fps(fps);
+	recorder->set_pacer_wait(pacer_wait);
+	recorder->set_encoder_mode(mode);
+	recorder->set_rate_control(rate_control);
+	recorder->set_bitrate(bitrate);
+	recorder->set_crf(crf);
+	recorder->set_max_bitrate(max_bitrate);
+	recorder->set_stats_dump(stats_file.c_str(), stats_interval_ms);
+	recorder->set_trace_output(trace_file.c_str());
+
+	int64_t cpu_start_us = PipelineStats::get_process_cpu_us();
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+	if (recorder->start_record() < 0)
+	{
+		fprintf(stderr, "cannot start recording\n");
+		delete recorder;
+		return 1;
+	}
+
+	while (!stop_requested)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (duration > 0 && std::chrono::steady_clock::now() - t_start >= std::chrono::seconds(duration))
+		{
+			break;
+		}
+	}
+
+	recorder->stop_record();
+	// wall time includes arming and finalizing, it only scales the cpu time
+	int64_t total_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+	int64_t cpu_us = PipelineStats::get_process_cpu_us() - cpu_start_us;
+
+	// the rate is over the recording itself, from the record clock origin to the stop
+	PipelineSnapshot stats = recorder->get_stats();
+	int64_t record_us = stats.elapsed_us;
+	int64_t captured = recorder->get_captured_frames();
+	// unchanged ticks are served by repeating the previous picture, they count towards the achieved rate
+	int64_t ticks = captured + recorder->get_unchanged_frames();
+	printf("output       %s (%s, %s)\n", output.c_str(), Encoder::get_mode_name(mode), Encoder::get_rate_control_name(rate_control));
+	printf("duration     %.2f s\n", record_us / 1000000.0);
+	printf("fps          %.2f achieved, %d requested\n", record_us > 0 ? ticks * 1000000.0 / record_us : 0.0, fps);
+	printf("tick error   p50 %lld us, p99 %lld us, max %lld us (%s)\n", (long long)recorder->get_tick_error_us(50),
+		(long long)recorder->get_tick_error_us(99), (long long)recorder->get_max_tick_error_us(), Pacer::get_wait_name(pacer_wait));
+	printf("frames       %lld captured, %lld unchanged, %lld dropped, %lld duplicated, %lld late\n",
+		(long long)captured, (long long)recorder->get_unchanged_frames(), (long long)recorder->get_dropped_frames(),
+		(long long)recorder->get_duplicated_frames(), (long long)recorder->get_late_frames());
+	printf("pickup       avg %lld us, max %lld us, %lld capture wakeups\n", (long long)recorder->get_average_pickup_latency_us(),
+		(long long)recorder->get_max_pickup_latency_us(), (long long)recorder->get_capture_wakeups());
+	printf("finalize     %.2f ms\n", recorder->get_finalize_us() / 1000.0);
+
+	printf("written      %lld bytes, frame queue max %d, write queue max %d\n", (long long)stats.bytes_written,
+		stats.max_frame_queue_depth, stats.max_write_queue_depth);
+	printf("packets      %lld encoded, %lld keyframes, sizes", (long long)stats.encoded_frames, (long long)stats.keyframe_packets);
+	for (int32_t i = 0; i < PACKET_SIZE_BUCKETS; i++)
+	{
+		if (stats.packet_size_histogram[i] == 0) continue;
+		printf(" %lld-%lld: %lld", 1LL << i, (1LL << (i + 1)) - 1, (long long)stats.packet_size_histogram[i]);
+	}
+	printf("\n");
+	printf("stage        count      mean       p50       p90       p99       max (us)\n");
+	for (int32_t i = 0; i < PIPELINE_STAGE_COUNT; i++)
+	{
+		const StageStats& stage = stats.stages[i];
+		printf("  %-10s %6lld %9lld %9lld %9lld %9lld %9lld\n", PipelineStats::get_stage_name((PipelineStage)i), (long long)stage.count,
+			(long long)stage.mean_us, (long long)stage.p50_us, (long long)stage.p90_us, (long long)stage.p99_us, (long long)stage.max_us);
+	}
+	printf("glass        to packet p50 %lld us, p90 %lld us, p99 %lld us, max %lld us over %lld new pictures\n",
+		(long long)stats.glass_to_packet.p50_us, (long long)stats.glass_to_packet.p90_us, (long long)stats.glass_to_packet.p99_us,
+		(long long)stats.glass_to_packet.max_us, (long long)stats.glass_to_packet.count);
+	printf("cpu time     %.2f s (%.1f%% of one core including finalize)\n", cpu_us / 1000000.0, total_us > 0 ? cpu_us * 100.0 / total_us : 0.0);
+
+	delete recorder;
+
+	return 0;
+}
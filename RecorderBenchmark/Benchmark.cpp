@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+
+std::string get_host()
+{
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "{\"os\":\"%s\",\"hardware_threads\":%u,\"pointer_bits\":%d}",
+#ifdef _WIN32
+		"windows",
+#else
+		"linux",
+#endif
+		std::thread::hardware_concurrency(), (int32_t)sizeof(void*) * 8);
+
+	return buffer;
+}
+
+int64_t percentile(const std::vector<int64_t>& sorted, double p)
+{
+	if (sorted.empty())
+	{
+		return 0;
+	}
+
+	size_t rank = (size_t)(p / 100.0 * sorted.size());
+	if (rank >= sorted.size()) rank = sorted.size() - 1;
+
+	return sorted[rank];
+}
+
+void on_log(void* verbose, const char* message)
+{
+	if (*(bool*)verbose) fputs(message, stderr);
+}
+
+BenchmarkOption int_option(const char* name, int32_t* value)
+{
+	return { name, false, [value](const char* text) { return (*value = atoi(text)) > 0; } };
+}
+
+BenchmarkOption int64_option(const char* name, int64_t* value)
+{
+	return { name, false, [value](const char* text) { return (*value = atoll(text)) > 0; } };
+}
+
+BenchmarkOption string_option(const char* name, std::string* value)
+{
+	return { name, false, [value](const char* text) { *value = text; return true; } };
+}
+
+BenchmarkOption flag_option(const char* name, bool* value)
+{
+	return { name, true, [value](const char*) { *value = true; return true; } };
+}
+
+BenchmarkOption size_option(const char* name, int32_t* width, int32_t* height, int32_t min_width, int32_t min_height)
+{
+	return { name, false, [=](const char* text) {
+		return sscanf(text, "%dx%d", width, height) == 2 && *width >= min_width && *height >= min_height;
+		} };
+}
+
+bool parse_options(int argc, char* argv[], const std::vector<BenchmarkOption>& options, void (*usage)(), int* exit_code)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		const BenchmarkOption* option = nullptr;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			*exit_code = 0;
+			return false;
+		}
+
+		for (const BenchmarkOption& candidate : options)
+		{
+			if (arg == candidate.name)
+			{
+				option = &candidate;
+				break;
+			}
+		}
+		if (!option)
+		{
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			usage();
+			*exit_code = 2;
+			return false;
+		}
+
+		if (option->flag)
+		{
+			option->parse(nullptr);
+			continue;
+		}
+
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			fprintf(stderr, "missing value for %s\n", arg.c_str());
+			usage();
+			*exit_code = 2;
+			return false;
+		}
+		i++;
+
+		if (!option->parse(value))
+		{
+			fprintf(stderr, "invalid value %s for %s\n", value, arg.c_str());
+			*exit_code = 2;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool parse_list(const char* value, const std::function<bool(const std::string& item)>& add)
+{
+	std::string remaining = value;
+	bool empty = true;
+
+	while (!remaining.empty())
+	{
+		size_t comma = remaining.find(',');
+		std::string item = remaining.substr(0, comma);
+		remaining = comma == std::string::npos ? "" : remaining.substr(comma + 1);
+
+		if (!add(item))
+		{
+			return false;
+		}
+		empty = false;
+	}
+
+	return !empty;
+}
+
+int32_t write_results(const std::string& json, const std::string& config, const std::vector<std::string>& results)
+{
+	FILE* file = json.empty() ? stdout : fopen(json.c_str(), "w");
+	if (!file)
+	{
+		fprintf(stderr, "cannot open %s\n", json.c_str());
+		return -1;
+	}
+
+	fprintf(file, "{\"version\":%d,\"host\":%s,\n", BENCHMARK_VERSION, get_host().c_str());
+	if (!config.empty())
+	{
+		fprintf(file, "\"config\":%s,\n", config.c_str());
+	}
+	fprintf(file, "\"results\":[\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		fprintf(file, "%s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "]}\n");
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	return 0;
+}
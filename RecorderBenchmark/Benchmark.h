@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// bump when a benchmark changes what it measures or how its results are laid out, results of different versions are not comparable
+#define BENCHMARK_VERSION 2
+
+// one command line option of a subcommand, parse stores the value and returns false when it is invalid,
+// a flag takes no value and its parse receives nullptr
+struct BenchmarkOption
+{
+	const char* name;
+	bool flag;
+	std::function<bool(const char* value)> parse;
+};
+
+// positive integers, any string, a flag that sets value to true and a WxH size of at least min_width by min_height
+BenchmarkOption int_option(const char* name, int32_t* value);
+BenchmarkOption int64_option(const char* name, int64_t* value);
+BenchmarkOption string_option(const char* name, std::string* value);
+BenchmarkOption flag_option(const char* name, bool* value);
+BenchmarkOption size_option(const char* name, int32_t* width, int32_t* height, int32_t min_width = 1, int32_t min_height = 1);
+
+// walks argv after the command name against options, --help and -h print usage. Returns false when the
+// command has to exit with *exit_code, 0 after the help text and 2 for a bad command line.
+bool parse_options(int argc, char* argv[], const std::vector<BenchmarkOption>& options, void (*usage)(), int* exit_code);
+// calls add for every entry of a comma separated list, false when add rejects one or the list is empty
+bool parse_list(const char* value, const std::function<bool(const std::string& item)>& add);
+
+// {"version","host","config","results":[...]} to json or stdout when it is empty, config is a JSON object
+// or empty to leave it out, every result is one JSON object. -1 when the file cannot be opened.
+int32_t write_results(const std::string& json, const std::string& config, const std::vector<std::string>& results);
+
+// JSON object describing the machine the results come from
+std::string get_host();
+// nearest rank on sorted samples
+int64_t percentile(const std::vector<int64_t>& sorted, double p);
+// recorder_set_log_callback target, opaque points to a bool that enables the core messages on stderr
+void on_log(void* verbose, const char* message);
+
+// end to end run of the whole recorder, argv[0] is the pipeline command
+int pipeline_main(int argc, char* argv[]);
+// recording of a stamped synthetic source, the output is decoded again to measure per frame latencies
+int probe_main(int argc, char* argv[]);
+// every frame policy against an artificially slow encoder, fails when the drop and duplicate counters do not add up
+int stress_main(int argc, char* argv[]);
+// real time encode into a throttled file writer, one write buffer against the default count
+int disk_main(int argc, char* argv[]);
+// tick errors of the frame pacer for every wait method and frame rate, nothing is captured or encoded
+int pacer_main(int argc, char* argv[]);
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Encoder.h"
+#include "RecorderApi.h"
+#include "SyntheticSource.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark disk [options]\n"
+		"  encodes a scrolling picture in real time into a file whose writer is throttled to --disk-rate,\n"
+		"  once with a single write buffer and once with the default count, and reports how long\n"
+		"  encode_frame took including the muxer waiting for a free buffer\n"
+		"  --size WxH             synthetic source size (default 1280x720)\n"
+		"  --fps N                frame rate (default 30)\n"
+		"  --bitrate N            encoder bitrate in bits per second (default 8000000)\n"
+		"  --buffer-kb N          write buffer size (default 256)\n"
+		"  --disk-rate N          disk speed in bytes per second (default twice the bitrate)\n"
+		"  --duration SECONDS     recording length per run (default 5)\n"
+		"  --output FILE          recorded file, overwritten by every run (default disk.mp4)\n"
+		"  --json FILE            JSON result file (default stdout)\n"
+		"  --verbose              print core messages to stderr\n");
+}
+
+int disk_main(int argc, char* argv[])
+{
+	int32_t width = 1280;
+	int32_t height = 720;
+	int32_t fps = 30;
+	int32_t bitrate = 8000000;
+	int32_t buffer_kb = 256;
+	int64_t disk_rate = 0;
+	int32_t duration = 5;
+	std::string output = "disk.mp4";
+	std::string json;
+	bool verbose = false;
+	int exit_code = 0;
+
+	std::vector<BenchmarkOption> options =
+	{
+		size_option("--size", &width, &height),
+		int_option("--fps", &fps),
+		int_option("--bitrate", &bitrate),
+		int_option("--buffer-kb", &buffer_kb),
+		int64_option("--disk-rate", &disk_rate),
+		int_option("--duration", &duration),
+		string_option("--output", &output),
+		string_option("--json", &json),
+		flag_option("--verbose", &verbose),
+	};
+	if (!parse_options(argc, argv, options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	// keeps up with the stream on average, a single buffer still waits for every write to finish
+	if (disk_rate == 0) disk_rate = (int64_t)bitrate / 8 * 2;
+
+	recorder_set_log_callback(on_log, &verbose);
+
+	SyntheticSource source;
+	if (source.initialize(width, height, 1000 / fps > 0 ? 1000 / fps : 1) < 0)
+	{
+		fprintf(stderr, "cannot initialize synthetic source\n");
+		return 1;
+	}
+	source.set_content(SYNTHETIC_CONTENT_SCROLL);
+	source.start_capture();
+
+	std::vector<uint8_t> frame(source.get_frame_buffer_length());
+	const int32_t buffer_counts[] = { 1, DEFAULT_WRITE_BUFFER_COUNT };
+	const int64_t interval_us = 1000000 / fps;
+	std::vector<std::string> results;
+
+	for (int32_t buffer_count : buffer_counts)
+	{
+		PipelineStats stats;
+		Encoder* encoder = new Encoder();
+		encoder->set_width(width);
+		encoder->set_height(height);
+		encoder->set_bytepixel(4);
+		encoder->set_fps(fps);
+		encoder->set_bitrate(bitrate);
+		encoder->set_write_buffer(buffer_kb * 1024, buffer_count);
+		encoder->set_write_rate(disk_rate);
+		encoder->set_stats(&stats);
+
+		if (encoder->initialize() < 0 || encoder->output_open(output.c_str()) < 0)
+		{
+			fprintf(stderr, "cannot open %s\n", output.c_str());
+			delete encoder;
+			source.stop_capture();
+			return 1;
+		}
+
+		int32_t frame_count = duration * fps;
+		std::vector<int64_t> frame_us;
+		frame_us.reserve(frame_count);
+		int64_t late_frames = 0;
+		FrameInfo info = {};
+		std::chrono::steady_clock::time_point t_run = std::chrono::steady_clock::now();
+
+		for (int32_t i = 0; i < frame_count; i++)
+		{
+			// real time pace, a frame that took too long is followed by the next one right away
+			std::this_thread::sleep_until(t_run + std::chrono::microseconds(i * interval_us));
+
+			source.get_frame_data(frame.data(), &info);
+			info.pts = i;
+			info.capture_us = i * interval_us;
+			info.present_us = -1;
+
+			std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+			if (encoder->encode_frame(frame.data(), info) < 0)
+			{
+				fprintf(stderr, "encode_frame error\n");
+				break;
+			}
+			int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+			frame_us.push_back(us);
+			if (us > interval_us) late_frames++;
+		}
+
+		encoder->output_close();
+
+		PipelineSnapshot snapshot = {};
+		stats.get_snapshot(&snapshot);
+		std::sort(frame_us.begin(), frame_us.end());
+		const StageStats& mux = snapshot.stages[PIPELINE_STAGE_MUX];
+		const StageStats& write = snapshot.stages[PIPELINE_STAGE_WRITE];
+
+		char buffer[1024];
+		snprintf(buffer, sizeof(buffer),
+			"{\"buffer_count\":%d,\"frames\":%d,\"late_frames\":%lld,\"frame_p50_us\":%lld,\"frame_p99_us\":%lld,\"frame_max_us\":%lld,"
+			"\"mux_p99_us\":%lld,\"mux_max_us\":%lld,\"write_mean_us\":%lld,\"writes\":%lld,\"bytes_written\":%lld,\"max_write_queue_depth\":%d}",
+			buffer_count, (int32_t)frame_us.size(), (long long)late_frames, (long long)percentile(frame_us, 50),
+			(long long)percentile(frame_us, 99), (long long)percentile(frame_us, 100), (long long)mux.p99_us, (long long)mux.max_us,
+			(long long)write.mean_us, (long long)write.count, (long long)snapshot.bytes_written, snapshot.max_write_queue_depth);
+		results.push_back(buffer);
+
+		fprintf(stderr, "%d write buffers : encode_frame p50 %lld us, p99 %lld us, max %lld us, %lld of %d frames over %lld us\n",
+			buffer_count, (long long)percentile(frame_us, 50), (long long)percentile(frame_us, 99), (long long)percentile(frame_us, 100),
+			(long long)late_frames, (int32_t)frame_us.size(), (long long)interval_us);
+
+		delete encoder;
+	}
+
+	source.stop_capture();
+
+	char config[256];
+	snprintf(config, sizeof(config), "{\"width\":%d,\"height\":%d,\"fps\":%d,\"bitrate\":%d,\"buffer_kb\":%d,\"disk_rate\":%lld,\"duration_s\":%d}",
+		width, height, fps, bitrate, buffer_kb, (long long)disk_rate, duration);
+
+	return write_results(json, config, results) < 0 ? 1 : 0;
+}
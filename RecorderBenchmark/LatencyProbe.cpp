@@ -0,0 +1,511 @@
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameStamp.h"
+#include "Recorder.h"
+#include "RecorderApi.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+// how often the output file size is sampled, the resolution of the capture to disk latency
+#define PROBE_DISK_POLL_US 1000
+// a live receiver retries until the recorder side accepts the connection
+#define PROBE_CONNECT_RETRY_MS 100
+
+// a decoded frame carrying a readable stamp, times on the steady clock in microseconds
+struct StampedFrame
+{
+	int64_t pts;			// in frame intervals, -1 when unknown
+	int64_t sequence;
+	int64_t stamp_us;		// when the source produced the picture
+	int64_t decoded_us;		// when the decoder returned the frame
+	int64_t end_pos;		// file offset right after the frame's packet, -1 when unknown
+};
+
+// output of one decode pass
+struct StampTrack
+{
+	std::vector<StampedFrame> frames;	// first frame of every new picture only
+	int64_t decoded_frames;
+	int64_t unreadable_frames;		// no valid stamp, such as the unstamped picture before the first update
+	int64_t repeated_frames;		// same picture as the frame before, unchanged ticks and duplicates
+	int64_t ready_us;				// decoder ready, earlier pictures may have waited for the receiver
+};
+
+// output file size over time, sampled while recording
+struct SizeSample
+{
+	int64_t time_us;
+	int64_t size;
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark probe [options]\n"
+		"  --size WxH             synthetic source size (default 1920x1080)\n"
+		"  --interval MS          mean time between stamped source updates (default one frame interval)\n"
+		"  --fps N                frame rate (default 60)\n"
+		"  --mode NAME            low-latency, throughput, archival (default low-latency)\n"
+		"  --duration SECONDS     recording length (default 10)\n"
+		"  --output FILE          recorded file, replaced by the run (default probe.mp4)\n"
+		"  --live URL             also stream to URL and receive it, udp://host:port or tcp://host:port?listen\n"
+		"  --receive URL          where the receiver reads the live stream (default the live URL without ?listen)\n"
+		"  --json FILE            JSON result file (default stdout)\n"
+		"  --verbose              print core messages to stderr\n");
+}
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t file_size(const char* filename)
+{
+#ifdef _WIN32
+	struct _stat64 status;
+	if (_stat64(filename, &status) != 0)
+	{
+		return -1;
+	}
+#else
+	struct stat status;
+	if (stat(filename, &status) != 0)
+	{
+		return -1;
+	}
+#endif
+
+	return (int64_t)status.st_size;
+}
+
+static int probe_interrupt(void* opaque)
+{
+	return *reinterpret_cast<std::atomic<bool>*>(opaque) ? 1 : 0;
+}
+
+// a live url is retried until the sender accepts the connection or abort is set
+static AVFormatContext* open_input(const char* url, bool live, std::atomic<bool>* abort)
+{
+	AVFormatContext* format_context = nullptr;
+	AVDictionary* options = nullptr;
+
+	for (;;)
+	{
+		format_context = avformat_alloc_context();
+		if (!format_context)
+		{
+			return nullptr;
+		}
+		format_context->interrupt_callback.callback = probe_interrupt;
+		format_context->interrupt_callback.opaque = abort;
+
+		// a live stream is read as it arrives, probing as little as possible
+		if (live)
+		{
+			av_dict_set(&options, "fflags", "nobuffer", 0);
+			av_dict_set(&options, "analyzeduration", "100000", 0);
+			av_dict_set(&options, "probesize", "65536", 0);
+		}
+
+		int ret = avformat_open_input(&format_context, url, live ? av_find_input_format("mpegts") : nullptr, &options);
+		av_dict_free(&options);
+		if (ret >= 0)
+		{
+			break;
+		}
+
+		// avformat_open_input frees the context on failure
+		if (!live || *abort)
+		{
+			fprintf(stderr, "cannot open %s\n", url);
+			return nullptr;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(PROBE_CONNECT_RETRY_MS));
+	}
+
+	if (avformat_find_stream_info(format_context, nullptr) < 0)
+	{
+		fprintf(stderr, "cannot read stream info of %s\n", url);
+		avformat_close_input(&format_context);
+		return nullptr;
+	}
+
+	return format_context;
+}
+
+static AVCodecContext* open_decoder(AVFormatContext* format_context, int32_t* stream_index)
+{
+	AVCodec* codec = nullptr;
+	AVCodecContext* codec_context = nullptr;
+
+	*stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+	if (*stream_index < 0 || !codec)
+	{
+		fprintf(stderr, "no video stream\n");
+		return nullptr;
+	}
+
+	codec_context = avcodec_alloc_context3(codec);
+	if (!codec_context)
+	{
+		return nullptr;
+	}
+
+	avcodec_parameters_to_context(codec_context, format_context->streams[*stream_index]->codecpar);
+	// frame threads would hold frames back, a single thread returns each one as soon as it is decoded
+	codec_context->thread_count = 1;
+	codec_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+	if (avcodec_open2(codec_context, codec, nullptr) < 0)
+	{
+		fprintf(stderr, "cannot open decoder\n");
+		avcodec_free_context(&codec_context);
+		return nullptr;
+	}
+
+	return codec_context;
+}
+
+// first frame of a new picture goes to the track, repeats and frames without a stamp are only counted
+static void add_decoded_frame(AVFrame* frame, AVStream* stream, std::map<int64_t, int64_t>& end_positions, int32_t fps, StampTrack* track)
+{
+	int64_t decoded_us = now_us();
+	FrameStamp stamp;
+
+	track->decoded_frames++;
+	if (frame->format != AV_PIX_FMT_YUV420P || frame->width < FRAME_STAMP_WIDTH || frame->height < FRAME_STAMP_HEIGHT ||
+		!read_frame_stamp(frame->data[0], frame->linesize[0], &stamp))
+	{
+		track->unreadable_frames++;
+		return;
+	}
+
+	if (!track->frames.empty() && track->frames.back().sequence == stamp.sequence)
+	{
+		track->repeated_frames++;
+		return;
+	}
+
+	StampedFrame stamped;
+	int64_t timestamp = frame->best_effort_timestamp;
+	int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+	std::map<int64_t, int64_t>::iterator end = end_positions.find(timestamp);
+	AVRational frame_time_base = { 1, fps };
+
+	stamped.pts = timestamp == AV_NOPTS_VALUE ? -1 : av_rescale_q(timestamp - start_time, stream->time_base, frame_time_base);
+	stamped.sequence = stamp.sequence;
+	stamped.stamp_us = unwrap_frame_stamp_time(stamp.time_us, decoded_us);
+	stamped.decoded_us = decoded_us;
+	stamped.end_pos = end == end_positions.end() ? -1 : end->second;
+	track->frames.push_back(stamped);
+}
+
+// demuxes and decodes url to the end or until abort, every frame's stamp is read from its luma plane
+static int32_t decode_stamps(const char* url, bool live, int32_t fps, std::atomic<bool>* abort, StampTrack* track)
+{
+	AVFormatContext* format_context = nullptr;
+	AVCodecContext* codec_context = nullptr;
+	AVPacket* packet = nullptr;
+	AVFrame* frame = nullptr;
+	std::map<int64_t, int64_t> end_positions;	// packet pts in stream time base to the offset after the packet
+	int32_t stream_index = -1;
+	int ret = 0;
+
+	track->decoded_frames = 0;
+	track->unreadable_frames = 0;
+	track->repeated_frames = 0;
+	track->ready_us = 0;
+
+	format_context = open_input(url, live, abort);
+	if (!format_context)
+	{
+		return -1;
+	}
+
+	codec_context = open_decoder(format_context, &stream_index);
+	packet = av_packet_alloc();
+	frame = av_frame_alloc();
+	if (!codec_context || !packet || !frame)
+	{
+		av_frame_free(&frame);
+		av_packet_free(&packet);
+		avcodec_free_context(&codec_context);
+		avformat_close_input(&format_context);
+		return -1;
+	}
+
+	track->ready_us = now_us();
+
+	for (;;)
+	{
+		ret = av_read_frame(format_context, packet);
+		if (ret < 0)
+		{
+			// end of file, or the live stream stopped, drain the decoder either way
+			avcodec_send_packet(codec_context, nullptr);
+		}
+		else if (packet->stream_index != stream_index)
+		{
+			av_packet_unref(packet);
+			continue;
+		}
+		else
+		{
+			if (packet->pos >= 0 && packet->pts != AV_NOPTS_VALUE) end_positions[packet->pts] = packet->pos + packet->size;
+			avcodec_send_packet(codec_context, packet);
+			av_packet_unref(packet);
+		}
+
+		while (avcodec_receive_frame(codec_context, frame) >= 0)
+		{
+			add_decoded_frame(frame, format_context->streams[stream_index], end_positions, fps, track);
+		}
+
+		if (ret < 0)
+		{
+			break;
+		}
+	}
+
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+	avcodec_free_context(&codec_context);
+	avformat_close_input(&format_context);
+
+	return 0;
+}
+
+// count and percentiles of a latency sample set as a JSON object
+static std::string format_latency(std::vector<int64_t> samples_us)
+{
+	char buffer[256];
+	int64_t total_us = 0;
+
+	std::sort(samples_us.begin(), samples_us.end());
+	for (int64_t sample : samples_us)
+	{
+		total_us += sample;
+	}
+
+	snprintf(buffer, sizeof(buffer), "{\"count\":%d,\"mean_us\":%lld,\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}",
+		(int32_t)samples_us.size(), (long long)(samples_us.empty() ? 0 : total_us / (int64_t)samples_us.size()),
+		(long long)percentile(samples_us, 50), (long long)percentile(samples_us, 90), (long long)percentile(samples_us, 99),
+		(long long)percentile(samples_us, 100));
+
+	return buffer;
+}
+
+static std::string format_track_counts(const StampTrack& track)
+{
+	char buffer[256];
+
+	snprintf(buffer, sizeof(buffer), "\"decoded_frames\":%lld,\"pictures\":%d,\"repeated_frames\":%lld,\"unreadable_frames\":%lld",
+		(long long)track.decoded_frames, (int32_t)track.frames.size(), (long long)track.repeated_frames, (long long)track.unreadable_frames);
+
+	return buffer;
+}
+
+int probe_main(int argc, char* argv[])
+{
+	int32_t width = 1920;
+	int32_t height = 1080;
+	int32_t interval_ms = 0;
+	int32_t fps = 60;
+	EncoderMode mode = ENCODER_MODE_LOW_LATENCY;
+	int32_t duration = 10;
+	std::string output = "probe.mp4";
+	std::string live_url;
+	std::string receive_url;
+	std::string json;
+	bool verbose = false;
+	int exit_code = 0;
+
+	std::vector<BenchmarkOption> options =
+	{
+		// the stamp has to fit into the picture
+		size_option("--size", &width, &height, FRAME_STAMP_WIDTH, FRAME_STAMP_HEIGHT),
+		int_option("--interval", &interval_ms),
+		int_option("--fps", &fps),
+		{ "--mode", false, [&](const char* value) { return Encoder::parse_mode_name(value, &mode); } },
+		int_option("--duration", &duration),
+		string_option("--output", &output),
+		string_option("--live", &live_url),
+		string_option("--receive", &receive_url),
+		string_option("--json", &json),
+		flag_option("--verbose", &verbose),
+	};
+	if (!parse_options(argc, argv, options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	if (interval_ms == 0) interval_ms = 1000 / fps > 0 ? 1000 / fps : 1;
+	if (!live_url.empty() && receive_url.empty())
+	{
+		receive_url = live_url.substr(0, live_url.find("?listen"));
+	}
+
+	recorder_set_log_callback(on_log, &verbose);
+
+	char display[128];
+	snprintf(display, sizeof(display), "synthetic:%dx%d@%d,stamp", width, height, interval_ms);
+	std::string display_name(display);
+
+	// packets leave the encoder on its thread, the vector is only read once the recording is finalized
+	std::vector<int64_t> encoded_us((size_t)(duration + 2) * fps, -1);
+
+	Recorder* recorder = new Recorder();
+	recorder->set_keep_warm(false);
+	recorder->set_display(std::wstring(display_name.begin(), display_name.end()).c_str());
+	recorder->set_output(output.c_str());
+	recorder->set_fps(fps);
+	recorder->set_encoder_mode(mode);
+	recorder->set_bitrate((int32_t)(4000000LL * width * height / (1920 * 1080)));
+	recorder->set_live_output(live_url.c_str(), 0, 0);
+	recorder->set_packet_callback([&encoded_us](const AVPacket* pkt, int64_t) {
+		if (pkt->pts >= 0 && pkt->pts < (int64_t)encoded_us.size()) encoded_us[pkt->pts] = now_us();
+	});
+
+	// a size left over from an earlier run would look like data already on disk
+	remove(output.c_str());
+
+	std::atomic<bool> running(true);
+	std::vector<SizeSample> sizes;
+	std::thread monitor([&]() {
+		int64_t last_size = 0;
+		while (running)
+		{
+			int64_t size = file_size(output.c_str());
+			if (size > last_size)
+			{
+				sizes.push_back({ now_us(), size });
+				last_size = size;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(PROBE_DISK_POLL_US));
+		}
+	});
+
+	// the receiver is up before the first packet is sent, a udp stream is not repeated
+	std::atomic<bool> receive_abort(false);
+	StampTrack live_track;
+	std::thread receiver;
+	if (!receive_url.empty())
+	{
+		receiver = std::thread([&]() {
+			decode_stamps(receive_url.c_str(), true, fps, &receive_abort, &live_track);
+		});
+	}
+
+	if (recorder->start_record() < 0)
+	{
+		fprintf(stderr, "cannot start recording\n");
+		running = false;
+		receive_abort = true;
+		monitor.join();
+		if (receiver.joinable()) receiver.join();
+		delete recorder;
+		return 1;
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(duration));
+	recorder->stop_record();
+
+	// the tail of the live stream may still be in flight
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	running = false;
+	receive_abort = true;
+	monitor.join();
+	if (receiver.joinable()) receiver.join();
+
+	std::atomic<bool> file_abort(false);
+	StampTrack file_track;
+	if (decode_stamps(output.c_str(), false, fps, &file_abort, &file_track) < 0)
+	{
+		delete recorder;
+		return 1;
+	}
+
+	std::vector<int64_t> encode_latency;
+	std::vector<int64_t> disk_latency;
+	std::string per_frame;
+	for (const StampedFrame& stamped : file_track.frames)
+	{
+		int64_t encode_us = stamped.pts >= 0 && stamped.pts < (int64_t)encoded_us.size() && encoded_us[stamped.pts] >= 0 ?
+			encoded_us[stamped.pts] - stamped.stamp_us : -1;
+		int64_t disk_us = -1;
+
+		// first sample where the file had grown past the packet
+		if (stamped.end_pos >= 0)
+		{
+			for (const SizeSample& sample : sizes)
+			{
+				if (sample.size >= stamped.end_pos)
+				{
+					disk_us = sample.time_us - stamped.stamp_us;
+					break;
+				}
+			}
+		}
+
+		if (encode_us >= 0) encode_latency.push_back(encode_us);
+		if (disk_us >= 0) disk_latency.push_back(disk_us);
+
+		char buffer[128];
+		snprintf(buffer, sizeof(buffer), "%s{\"pts\":%lld,\"sequence\":%lld,\"encode_us\":%lld,\"disk_us\":%lld}",
+			per_frame.empty() ? "" : ",", (long long)stamped.pts, (long long)stamped.sequence, (long long)encode_us, (long long)disk_us);
+		per_frame += buffer;
+	}
+
+	char config[512];
+	snprintf(config, sizeof(config), "{\"width\":%d,\"height\":%d,\"interval_ms\":%d,\"fps\":%d,\"mode\":\"%s\",\"duration_s\":%d,"
+		"\"disk_poll_us\":%d,\"live\":\"%s\"}",
+		width, height, interval_ms, fps, Encoder::get_mode_name(mode), duration, PROBE_DISK_POLL_US, live_url.c_str());
+
+	// one result per output the stamps were decoded from
+	std::vector<std::string> results;
+	results.push_back("{\"output\":\"file\"," + format_track_counts(file_track) + ",\"capture_to_encode\":" + format_latency(encode_latency) +
+		",\"capture_to_disk\":" + format_latency(disk_latency) + ",\n\"frames\":[" + per_frame + "]}");
+
+	if (!receive_url.empty())
+	{
+		std::vector<int64_t> receive_latency;
+		std::string live_frames;
+		for (const StampedFrame& stamped : live_track.frames)
+		{
+			// pictures produced before the receiver was ready waited for it, not for the pipeline
+			if (stamped.stamp_us < live_track.ready_us)
+			{
+				continue;
+			}
+
+			receive_latency.push_back(stamped.decoded_us - stamped.stamp_us);
+
+			char buffer[96];
+			snprintf(buffer, sizeof(buffer), "%s{\"sequence\":%lld,\"receive_us\":%lld}",
+				live_frames.empty() ? "" : ",", (long long)stamped.sequence, (long long)(stamped.decoded_us - stamped.stamp_us));
+			live_frames += buffer;
+		}
+
+		results.push_back("{\"output\":\"live\"," + format_track_counts(live_track) + ",\"capture_to_receive\":" +
+			format_latency(receive_latency) + ",\n\"frames\":[" + live_frames + "]}");
+	}
+
+	delete recorder;
+
+	return write_results(json, config, results) < 0 ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Pacer.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark pacer [options]\n"
+		"  runs the frame pacer with every wait method at every rate and reports how far the wakeups\n"
+		"  landed from their deadlines\n"
+		"  --rates LIST           comma separated frame rates (default 30,60,144)\n"
+		"  --waits LIST           comma separated subset of sleep,precise (default both)\n"
+		"  --duration SECONDS     length of every run (default 3)\n"
+		"  --json FILE            JSON result file (default stdout)\n");
+}
+
+int pacer_main(int argc, char* argv[])
+{
+	std::vector<int32_t> rates = { 30, 60, 144 };
+	std::vector<PacerWait> waits = { PACER_WAIT_SLEEP, PACER_WAIT_PRECISE };
+	int32_t duration = 3;
+	std::string json;
+	int exit_code = 0;
+
+	std::vector<BenchmarkOption> options =
+	{
+		{ "--rates", false, [&](const char* value) {
+			rates.clear();
+			return parse_list(value, [&](const std::string& item) {
+				int32_t fps = atoi(item.c_str());
+				rates.push_back(fps);
+				return fps > 0;
+				});
+			} },
+		{ "--waits", false, [&](const char* value) {
+			waits.clear();
+			return parse_list(value, [&](const std::string& item) {
+				PacerWait wait;
+				if (!Pacer::parse_wait_name(item.c_str(), &wait)) return false;
+				waits.push_back(wait);
+				return true;
+				});
+			} },
+		int_option("--duration", &duration),
+		string_option("--json", &json),
+	};
+	if (!parse_options(argc, argv, options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	std::vector<std::string> results;
+
+	for (PacerWait wait : waits)
+	{
+		for (int32_t fps : rates)
+		{
+			Pacer pacer;
+			pacer.set_wait(wait);
+			pacer.start(fps, std::chrono::steady_clock::now());
+
+			// an idle caller, every tick error comes from the wait itself
+			int64_t last_tick = (int64_t)duration * fps - 1;
+			while (pacer.wait_next() < last_tick)
+			{
+			}
+
+			char buffer[512];
+			snprintf(buffer, sizeof(buffer),
+				"{\"wait\":\"%s\",\"fps\":%d,\"ticks\":%lld,\"skipped_ticks\":%lld,\"error_p50_us\":%lld,\"error_p99_us\":%lld,\"error_max_us\":%lld}",
+				Pacer::get_wait_name(wait), fps, (long long)pacer.get_ticks(), (long long)pacer.get_skipped_ticks(),
+				(long long)pacer.get_error_percentile_us(50), (long long)pacer.get_error_percentile_us(99), (long long)pacer.get_max_error_us());
+			results.push_back(buffer);
+
+			fprintf(stderr, "%-8s %4d fps : tick error p50 %lld us, p99 %lld us, max %lld us, %lld of %lld ticks skipped\n",
+				Pacer::get_wait_name(wait), fps, (long long)pacer.get_error_percentile_us(50), (long long)pacer.get_error_percentile_us(99),
+				(long long)pacer.get_max_error_us(), (long long)pacer.get_skipped_ticks(), (long long)pacer.get_ticks());
+		}
+	}
+
+	char config[64];
+	snprintf(config, sizeof(config), "{\"duration_s\":%d}", duration);
+
+	return write_results(json, config, results) < 0 ? 1 : 0;
+}
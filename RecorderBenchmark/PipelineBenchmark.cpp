@@ -0,0 +1,192 @@
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Recorder.h"
+#include "RecorderApi.h"
+#include "SyntheticSource.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+// named synthetic workloads, interval 0 means one update per frame interval on average
+struct ContentPreset
+{
+	const char* name;
+	SyntheticContent content;
+	int32_t interval_ms;
+};
+
+static const ContentPreset contents[] =
+{
+	{ "idle", SYNTHETIC_CONTENT_BLOCK, 2000 },		// mostly unchanged screen, keepalive frames only
+	{ "desktop", SYNTHETIC_CONTENT_BLOCK, 100 },	// pointer and typing sized changes several times a second
+	{ "scroll", SYNTHETIC_CONTENT_SCROLL, 0 },		// whole picture changes about every frame
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark pipeline [options]\n"
+		"  --size WxH             synthetic source size (default 1920x1080)\n"
+		"  --content NAME         idle, desktop, scroll (default desktop)\n"
+		"  --interval MS          mean time between source updates, overrides the content default\n"
+		"  --fps N                frame rate (default 60)\n"
+		"  --mode NAME            low-latency, throughput, archival (default low-latency)\n"
+		"  --pacer NAME           sleep, precise (default sleep)\n"
+		"  --duration SECONDS     recording length (default 10)\n"
+		"  --output FILE          recorded file (default pipeline.mp4)\n"
+		"  --json FILE            JSON result file (default stdout)\n"
+		"  --verbose              print core messages to stderr\n");
+}
+
+// largest resident set of the process so far
+static int64_t peak_rss_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	}
+
+	return (int64_t)(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	return (int64_t)usage.ru_maxrss;
+#endif
+}
+
+static bool parse_content(const char* value, const ContentPreset** preset)
+{
+	for (const ContentPreset& content : contents)
+	{
+		if (strcmp(value, content.name) == 0)
+		{
+			*preset = &content;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int pipeline_main(int argc, char* argv[])
+{
+	int32_t width = 1920;
+	int32_t height = 1080;
+	const ContentPreset* content = &contents[1];
+	int32_t interval_ms = 0;
+	int32_t fps = 60;
+	EncoderMode mode = ENCODER_MODE_LOW_LATENCY;
+	PacerWait pacer_wait = PACER_WAIT_SLEEP;
+	int32_t duration = 10;
+	std::string output = "pipeline.mp4";
+	std::string json;
+	bool verbose = false;
+	int exit_code = 0;
+
+	std::vector<BenchmarkOption> options =
+	{
+		size_option("--size", &width, &height),
+		{ "--content", false, [&](const char* value) { return parse_content(value, &content); } },
+		int_option("--interval", &interval_ms),
+		int_option("--fps", &fps),
+		{ "--mode", false, [&](const char* value) { return Encoder::parse_mode_name(value, &mode); } },
+		{ "--pacer", false, [&](const char* value) { return Pacer::parse_wait_name(value, &pacer_wait); } },
+		int_option("--duration", &duration),
+		string_option("--output", &output),
+		string_option("--json", &json),
+		flag_option("--verbose", &verbose),
+	};
+	if (!parse_options(argc, argv, options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	if (interval_ms == 0) interval_ms = content->interval_ms;
+	if (interval_ms == 0) interval_ms = 1000 / fps > 0 ? 1000 / fps : 1;
+
+	recorder_set_log_callback(on_log, &verbose);
+
+	// the generated source keeps the run headless and repeatable, its event times are the glass times
+	char display[128];
+	snprintf(display, sizeof(display), "synthetic:%dx%d@%d%s", width, height, interval_ms,
+		content->content == SYNTHETIC_CONTENT_SCROLL ? ",scroll" : "");
+	std::string display_name(display);
+
+	Recorder* recorder = new Recorder();
+	recorder->set_keep_warm(false);
+	recorder->set_display(std::wstring(display_name.begin(), display_name.end()).c_str());
+	recorder->set_output(output.c_str());
+	recorder->set_fps(fps);
+	recorder->set_encoder_mode(mode);
+	recorder->set_pacer_wait(pacer_wait);
+	// the default rate of the recorder, 4 Mbps at 1080p, scaled by pixel count
+	recorder->set_bitrate((int32_t)(4000000LL * width * height / (1920 * 1080)));
+
+	int64_t cpu_start_us = PipelineStats::get_process_cpu_us();
+
+	if (recorder->start_record() < 0)
+	{
+		fprintf(stderr, "cannot start recording\n");
+		delete recorder;
+		return 1;
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(duration));
+
+	recorder->stop_record();
+	int64_t cpu_us = PipelineStats::get_process_cpu_us() - cpu_start_us;
+
+	// from the record clock origin to the stop, arming before it is not part of the achieved rate
+	PipelineSnapshot stats = recorder->get_stats();
+	int64_t record_us = stats.elapsed_us;
+	// unchanged ticks are served by repeating the previous picture, they count towards the achieved rate
+	int64_t ticks = recorder->get_captured_frames() + recorder->get_unchanged_frames();
+	const StageStats& glass = stats.glass_to_packet;
+
+	char config[512];
+	snprintf(config, sizeof(config), "{\"width\":%d,\"height\":%d,\"content\":\"%s\",\"interval_ms\":%d,\"fps\":%d,\"mode\":\"%s\","
+		"\"pacer\":\"%s\",\"duration_s\":%d}",
+		width, height, content->name, interval_ms, fps, Encoder::get_mode_name(mode), Pacer::get_wait_name(pacer_wait), duration);
+
+	char buffer[2048];
+	snprintf(buffer, sizeof(buffer), "{\"record_us\":%lld,\"fps\":%.2f,\"captured_frames\":%lld,\"unchanged_frames\":%lld,"
+		"\"dropped_frames\":%lld,\"duplicated_frames\":%lld,\"late_frames\":%lld,"
+		"\"glass_to_packet\":{\"count\":%lld,\"mean_us\":%lld,\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld},"
+		"\"pickup_avg_us\":%lld,\"pickup_max_us\":%lld,\"capture_wakeups\":%lld,\"tick_error_p99_us\":%lld,"
+		"\"cpu_us\":%lld,\"cpu_us_per_frame\":%lld,\"peak_rss_kb\":%lld,\"encoded_frames\":%lld,\"encoded_bytes\":%lld,"
+		"\"bytes_written\":%lld,\"finalize_us\":%lld,",
+		(long long)record_us, record_us > 0 ? ticks * 1000000.0 / record_us : 0.0, (long long)recorder->get_captured_frames(),
+		(long long)recorder->get_unchanged_frames(), (long long)recorder->get_dropped_frames(), (long long)recorder->get_duplicated_frames(),
+		(long long)recorder->get_late_frames(), (long long)glass.count, (long long)glass.mean_us, (long long)glass.p50_us,
+		(long long)glass.p90_us, (long long)glass.p99_us, (long long)glass.max_us,
+		(long long)recorder->get_average_pickup_latency_us(), (long long)recorder->get_max_pickup_latency_us(),
+		(long long)recorder->get_capture_wakeups(), (long long)recorder->get_tick_error_us(99), (long long)cpu_us,
+		(long long)(stats.encoded_frames > 0 ? cpu_us / stats.encoded_frames : 0), (long long)peak_rss_kb(),
+		(long long)stats.encoded_frames, (long long)stats.encoded_bytes, (long long)stats.bytes_written, (long long)recorder->get_finalize_us());
+
+	// the single run carries the full stats snapshot next to its summary
+	std::vector<std::string> results;
+	results.push_back(std::string(buffer) + "\"stats\":" + PipelineStats::format_json(stats) + "}");
+
+	delete recorder;
+
+	return write_results(json, config, results) < 0 ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Recorder.h"
+#include "RecorderApi.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark stress [options]\n"
+		"  records a source that changes every frame through an encoder slowed down by --encode-delay,\n"
+		"  once per frame policy, and checks the drop and duplicate counters against the frames encoded\n"
+		"  --size WxH             synthetic source size (default 640x360)\n"
+		"  --fps N                frame rate (default 60)\n"
+		"  --encode-delay MS      added to every encoded frame (default two frame intervals)\n"
+		"  --capacity N           frame queue capacity (default 3)\n"
+		"  --duration SECONDS     recording length per policy (default 3)\n"
+		"  --output FILE          recorded file, overwritten by every run (default stress.mp4)\n"
+		"  --json FILE            JSON result file (default stdout)\n"
+		"  --verbose              print core messages to stderr\n");
+}
+
+// first expectation of the policy that the run violates, empty when the run passed
+static std::string check_run(FramePolicy policy, int32_t capacity, const PipelineSnapshot& stats)
+{
+	if (stats.max_frame_queue_depth > capacity)
+	{
+		return "frame queue grew past its capacity";
+	}
+	if (stats.captured_frames == 0)
+	{
+		return "no frame captured";
+	}
+
+	switch (policy)
+	{
+	case FRAME_POLICY_DROP_NEWEST:
+		// skipped frames are never copied, everything captured is encoded
+		if (stats.dropped_frames == 0) return "slow encoder but no frame dropped";
+		if (stats.duplicated_frames != 0) return "frames duplicated";
+		if (stats.encoded_frames != stats.captured_frames) return "encoded frames differ from captured frames";
+		break;
+
+	case FRAME_POLICY_DROP_OLDEST:
+		// evicted frames were captured first
+		if (stats.dropped_frames == 0) return "slow encoder but no frame dropped";
+		if (stats.duplicated_frames != 0) return "frames duplicated";
+		if (stats.encoded_frames != stats.captured_frames - stats.dropped_frames) return "encoded frames differ from captured minus dropped frames";
+		break;
+
+	case FRAME_POLICY_DUPLICATE_LAST:
+		// every skipped tick comes back as a repeated picture
+		if (stats.dropped_frames != 0) return "frames dropped";
+		if (stats.duplicated_frames == 0) return "slow encoder but no frame duplicated";
+		if (stats.encoded_frames != stats.captured_frames + stats.duplicated_frames) return "encoded frames differ from captured plus duplicated frames";
+		break;
+	}
+
+	return "";
+}
+
+int stress_main(int argc, char* argv[])
+{
+	int32_t width = 640;
+	int32_t height = 360;
+	int32_t fps = 60;
+	int32_t encode_delay_ms = 0;
+	int32_t capacity = 3;
+	int32_t duration = 3;
+	std::string output = "stress.mp4";
+	std::string json;
+	bool verbose = false;
+	int exit_code = 0;
+
+	std::vector<BenchmarkOption> options =
+	{
+		size_option("--size", &width, &height),
+		int_option("--fps", &fps),
+		int_option("--encode-delay", &encode_delay_ms),
+		int_option("--capacity", &capacity),
+		int_option("--duration", &duration),
+		string_option("--output", &output),
+		string_option("--json", &json),
+		flag_option("--verbose", &verbose),
+	};
+	if (!parse_options(argc, argv, options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	// the encoder keeps up with every other frame at most
+	if (encode_delay_ms == 0) encode_delay_ms = 2 * 1000 / fps > 0 ? 2 * 1000 / fps : 1;
+
+	recorder_set_log_callback(on_log, &verbose);
+
+	// a scrolling picture that updates about every frame interval, so most ticks carry a new frame
+	char display[128];
+	snprintf(display, sizeof(display), "synthetic:%dx%d@%d,scroll", width, height, 1000 / fps > 0 ? 1000 / fps : 1);
+	std::string display_name(display);
+
+	std::vector<std::string> results;
+	bool passed = true;
+
+	for (int32_t i = FRAME_POLICY_DROP_NEWEST; i <= FRAME_POLICY_DUPLICATE_LAST; i++)
+	{
+		FramePolicy policy = (FramePolicy)i;
+
+		Recorder* recorder = new Recorder();
+		recorder->set_keep_warm(false);
+		recorder->set_display(std::wstring(display_name.begin(), display_name.end()).c_str());
+		recorder->set_output(output.c_str());
+		recorder->set_fps(fps);
+		recorder->set_frame_policy(policy);
+		recorder->set_queue_capacity(capacity);
+		recorder->set_encode_delay(encode_delay_ms);
+		// a truncated drain would break the frame accounting
+		recorder->set_finalize_deadline(0);
+
+		if (recorder->start_record() < 0)
+		{
+			fprintf(stderr, "cannot start recording\n");
+			delete recorder;
+			return 1;
+		}
+
+		std::this_thread::sleep_for(std::chrono::seconds(duration));
+		recorder->stop_record();
+
+		PipelineSnapshot stats = recorder->get_stats();
+		std::string failure = check_run(policy, capacity, stats);
+		passed = passed && failure.empty();
+
+		char buffer[1024];
+		snprintf(buffer, sizeof(buffer),
+			"{\"policy\":\"%s\",\"captured_frames\":%lld,\"dropped_frames\":%lld,\"duplicated_frames\":%lld,"
+			"\"late_frames\":%lld,\"encoded_frames\":%lld,\"max_frame_queue_depth\":%d,\"passed\":%s%s%s%s}",
+			FrameQueue::get_policy_name(policy), (long long)stats.captured_frames, (long long)stats.dropped_frames,
+			(long long)stats.duplicated_frames, (long long)recorder->get_late_frames(), (long long)stats.encoded_frames,
+			stats.max_frame_queue_depth, failure.empty() ? "true" : "false",
+			failure.empty() ? "" : ",\"failure\":\"", failure.c_str(), failure.empty() ? "" : "\"");
+		results.push_back(buffer);
+
+		fprintf(stderr, "%-15s captured %6lld  dropped %6lld  duplicated %6lld  encoded %6lld  max depth %d/%d  %s\n",
+			FrameQueue::get_policy_name(policy), (long long)stats.captured_frames, (long long)stats.dropped_frames,
+			(long long)stats.duplicated_frames, (long long)stats.encoded_frames, stats.max_frame_queue_depth, capacity,
+			failure.empty() ? "ok" : failure.c_str());
+
+		delete recorder;
+	}
+
+	char config[256];
+	snprintf(config, sizeof(config), "{\"width\":%d,\"height\":%d,\"fps\":%d,\"encode_delay_ms\":%d,\"capacity\":%d,\"duration_s\":%d}",
+		width, height, fps, encode_delay_ms, capacity, duration);
+	if (write_results(json, config, results) < 0)
+	{
+		return 1;
+	}
+
+	return passed ? 0 : 1;
+}
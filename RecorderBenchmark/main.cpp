@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Encoder.h"
+#include "FrameKernels.h"
+#include "RecorderApi.h"
+#include "SyntheticSource.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+// the padded pitch of a mapped staging texture, rows start on this alignment plus one extra line of slack
+#define BENCHMARK_PITCH_ALIGNMENT 256
+// regions reported by one busy frame in the change detection benchmark
+#define BENCHMARK_REGIONS_PER_FRAME 64
+
+struct Resolution
+{
+	const char* name;
+	int32_t width;
+	int32_t height;
+};
+
+static const Resolution resolutions[] =
+{
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4k", 3840, 2160 },
+};
+
+struct BenchmarkOptions
+{
+	std::string filter;
+	std::vector<Resolution> resolutions;
+	int32_t iterations;
+	int32_t encode_frames;
+	bool verbose;
+};
+
+static std::vector<std::string> results;
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: RecorderBenchmark [options]\n"
+		"       RecorderBenchmark pipeline [options]   end to end run, see pipeline --help\n"
+		"       RecorderBenchmark probe [options]      stamped glass to file latency, see probe --help\n"
+		"       RecorderBenchmark stress [options]     frame policies under a slow encoder, see stress --help\n"
+		"       RecorderBenchmark disk [options]       encoding into a throttled disk, see disk --help\n"
+		"       RecorderBenchmark pacer [options]      frame pacer wakeup accuracy, see pacer --help\n"
+		"  --output FILE          JSON results file (default stdout)\n"
+		"  --filter NAME          run only benchmarks whose name contains NAME\n"
+		"                         (copy, compact, convert, regions, encode, encode_roi)\n"
+		"  --resolutions LIST     comma separated subset of 720p,1080p,1440p,4k (default all)\n"
+		"  --iterations N         timed iterations of every kernel (default 200)\n"
+		"  --encode-frames N      frames per encode run (default 120)\n"
+		"  --verbose              print core messages to stderr\n");
+}
+
+static int64_t elapsed_ns(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// one result object, extra holds additional "key":value pairs of the benchmark without a leading comma
+static void add_result(const char* name, const Resolution& resolution, std::vector<int64_t> samples_ns, int64_t bytes, const std::string& extra)
+{
+	char buffer[1024];
+	int64_t total_ns = 0;
+
+	std::sort(samples_ns.begin(), samples_ns.end());
+	for (int64_t sample : samples_ns)
+	{
+		total_ns += sample;
+	}
+	int64_t mean_ns = samples_ns.empty() ? 0 : total_ns / (int64_t)samples_ns.size();
+
+	snprintf(buffer, sizeof(buffer),
+		"{\"name\":\"%s\",\"resolution\":\"%s\",\"width\":%d,\"height\":%d,\"iterations\":%d,"
+		"\"mean_ns\":%lld,\"min_ns\":%lld,\"p50_ns\":%lld,\"p90_ns\":%lld,\"p99_ns\":%lld,\"max_ns\":%lld,\"mb_per_s\":%.1f%s%s}",
+		name, resolution.name, resolution.width, resolution.height, (int32_t)samples_ns.size(),
+		(long long)mean_ns, (long long)percentile(samples_ns, 0), (long long)percentile(samples_ns, 50),
+		(long long)percentile(samples_ns, 90), (long long)percentile(samples_ns, 99), (long long)percentile(samples_ns, 100),
+		mean_ns > 0 ? bytes * 1000.0 / mean_ns : 0.0, extra.empty() ? "" : ",", extra.c_str());
+	results.push_back(buffer);
+
+	fprintf(stderr, "%-22s %-6s mean %9.1f us  p50 %9.1f us  p99 %9.1f us\n", name, resolution.name,
+		mean_ns / 1000.0, percentile(samples_ns, 50) / 1000.0, percentile(samples_ns, 99) / 1000.0);
+}
+
+// untimed warmup first so caches, page faults and lazy initialization do not land in the samples
+static std::vector<int64_t> measure(int32_t iterations, const std::function<void()>& kernel)
+{
+	std::vector<int64_t> samples_ns;
+
+	for (int32_t i = 0; i < iterations / 10 + 1; i++)
+	{
+		kernel();
+	}
+
+	samples_ns.reserve(iterations);
+	for (int32_t i = 0; i < iterations; i++)
+	{
+		std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+		kernel();
+		samples_ns.push_back(elapsed_ns(t_start));
+	}
+
+	return samples_ns;
+}
+
+static bool selected(const BenchmarkOptions& options, const char* name)
+{
+	return options.filter.empty() || strstr(name, options.filter.c_str()) != nullptr;
+}
+
+// area of the moving block fill_frame paints into frame
+static FrameRegion block_region(int32_t width, int32_t height, int32_t frame)
+{
+	FrameRegion block;
+	block.left = (frame * 16) % (width - SYNTHETIC_BLOCK_SIZE);
+	block.top = (frame * 8) % (height - SYNTHETIC_BLOCK_SIZE);
+	block.right = block.left + SYNTHETIC_BLOCK_SIZE;
+	block.bottom = block.top + SYNTHETIC_BLOCK_SIZE;
+	return block;
+}
+
+// a desktop like picture, horizontal gradients with a moving block so consecutive frames differ in a small area
+static void fill_frame(uint8_t* buffer, int32_t width, int32_t height, int32_t frame)
+{
+	for (int32_t y = 0; y < height; y++)
+	{
+		uint32_t* row = (uint32_t*)(buffer + (int64_t)y * width * 4);
+		for (int32_t x = 0; x < width; x++)
+		{
+			row[x] = 0xFF000000 | ((x * 255 / width) << 16) | ((y * 255 / height) << 8) | ((x ^ y) & 0x3F);
+		}
+	}
+
+	FrameRegion block = block_region(width, height, frame);
+	for (int32_t y = block.top; y < block.bottom; y++)
+	{
+		uint32_t* row = (uint32_t*)(buffer + (int64_t)y * width * 4);
+		for (int32_t x = block.left; x < block.right; x++)
+		{
+			row[x] = 0xFFFFFFFF - (uint32_t)frame * 0x010203;
+		}
+	}
+}
+
+// latest picture out of a capture source into a frame queue slot, the copy the record thread makes every tick
+static void bench_copy(const BenchmarkOptions& options, const Resolution& resolution)
+{
+	SyntheticSource source;
+	if (source.initialize(resolution.width, resolution.height, 1000) < 0)
+	{
+		fprintf(stderr, "cannot initialize synthetic source\n");
+		return;
+	}
+
+	std::vector<uint8_t> frame(source.get_frame_buffer_length());
+	FrameInfo info = {};
+	std::vector<int64_t> samples_ns = measure(options.iterations, [&]() {
+		source.get_frame_data(frame.data(), &info);
+	});
+
+	add_result("copy", resolution, samples_ns, source.get_frame_buffer_length(), "");
+}
+
+// mapped texture rows packed into a contiguous frame, padded is the usual case, contiguous takes the single copy path
+static void bench_compact(const BenchmarkOptions& options, const Resolution& resolution)
+{
+	int64_t row_bytes = (int64_t)resolution.width * 4;
+	int64_t padded_pitch = (row_bytes + BENCHMARK_PITCH_ALIGNMENT - 1) / BENCHMARK_PITCH_ALIGNMENT * BENCHMARK_PITCH_ALIGNMENT + BENCHMARK_PITCH_ALIGNMENT;
+	std::vector<uint8_t> mapped(padded_pitch * resolution.height, 0x80);
+	std::vector<uint8_t> frame(row_bytes * resolution.height);
+
+	std::vector<int64_t> samples_ns = measure(options.iterations, [&]() {
+		copy_rows(frame.data(), mapped.data(), padded_pitch, row_bytes, resolution.height);
+	});
+	add_result("compact_padded", resolution, samples_ns, row_bytes * resolution.height,
+		"\"pitch\":" + std::to_string(padded_pitch));
+
+	samples_ns = measure(options.iterations, [&]() {
+		copy_rows(frame.data(), mapped.data(), row_bytes, row_bytes, resolution.height);
+	});
+	add_result("compact_contiguous", resolution, samples_ns, row_bytes * resolution.height,
+		"\"pitch\":" + std::to_string(row_bytes));
+}
+
+// BGRA to YUV420P with the flags the encoder uses, same size conversion and the bilinear downscale to half size
+static void bench_convert(const BenchmarkOptions& options, const Resolution& resolution)
+{
+	std::vector<uint8_t> frame((int64_t)resolution.width * resolution.height * 4);
+	fill_frame(frame.data(), resolution.width, resolution.height, 0);
+
+	for (int32_t scaled = 0; scaled < 2; scaled++)
+	{
+		int32_t out_width = scaled ? (resolution.width / 2) & ~1 : resolution.width;
+		int32_t out_height = scaled ? (resolution.height / 2) & ~1 : resolution.height;
+		uint8_t* out_data[4] = {};
+		int out_linesize[4] = {};
+
+		SwsContext* swsctx = sws_getContext(resolution.width, resolution.height, AV_PIX_FMT_BGRA,
+			out_width, out_height, AV_PIX_FMT_YUV420P, scaled ? SWS_BILINEAR : 0, 0, 0, 0);
+		if (!swsctx || av_image_alloc(out_data, out_linesize, out_width, out_height, AV_PIX_FMT_YUV420P, 32) < 0)
+		{
+			fprintf(stderr, "cannot set up conversion\n");
+			sws_freeContext(swsctx);
+			return;
+		}
+
+		uint8_t* in_data[1] = { frame.data() };
+		int in_linesize[1] = { resolution.width * 4 };
+		std::vector<int64_t> samples_ns = measure(options.iterations, [&]() {
+			sws_scale(swsctx, in_data, in_linesize, 0, resolution.height, out_data, out_linesize);
+		});
+
+		char extra[64];
+		snprintf(extra, sizeof(extra), "\"out_width\":%d,\"out_height\":%d", out_width, out_height);
+		add_result(scaled ? "convert_scaled" : "convert", resolution, samples_ns, (int64_t)resolution.width * resolution.height * 4, extra);
+
+		av_freep(&out_data[0]);
+		sws_freeContext(swsctx);
+	}
+}
+
+// damage rectangles of a busy frame folded into the fixed size region list
+static void bench_regions(const BenchmarkOptions& options, const Resolution& resolution)
+{
+	std::mt19937 random(12345);
+	std::vector<FrameRegion> rects(BENCHMARK_REGIONS_PER_FRAME);
+	for (FrameRegion& rect : rects)
+	{
+		int32_t width = 8 + (int32_t)(random() % 256);
+		int32_t height = 8 + (int32_t)(random() % 256);
+		rect.left = (int32_t)(random() % (resolution.width - width));
+		rect.top = (int32_t)(random() % (resolution.height - height));
+		rect.right = rect.left + width;
+		rect.bottom = rect.top + height;
+	}
+
+	FrameRegion regions[MAX_FRAME_REGIONS];
+	int32_t count = 0;
+	std::vector<int64_t> samples_ns = measure(options.iterations, [&]() {
+		count = 0;
+		for (const FrameRegion& rect : rects)
+		{
+			add_frame_region(regions, &count, rect);
+		}
+	});
+
+	add_result("regions", resolution, samples_ns, 0, "\"regions_per_frame\":" + std::to_string(BENCHMARK_REGIONS_PER_FRAME));
+}
+
+// one full encode_frame per sample, conversion included, then the flush so every submitted frame has its packet
+static void bench_encode(const BenchmarkOptions& options, const Resolution& resolution, EncoderMode mode)
+{
+	const int32_t fps = 30;
+	// 4 Mbps at 1080p scaled by pixel count, the default rate of the recorder
+	int32_t bitrate = (int32_t)(4000000LL * resolution.width * resolution.height / (1920 * 1080));
+	int32_t frame_count = options.encode_frames;
+	int64_t frame_length = (int64_t)resolution.width * resolution.height * 4;
+
+	// content is prepared up front so painting is not measured, a short loop of distinct pictures
+	const int32_t distinct_frames = 8;
+	std::vector<uint8_t> frames(frame_length * distinct_frames);
+	for (int32_t i = 0; i < distinct_frames; i++)
+	{
+		fill_frame(frames.data() + frame_length * i, resolution.width, resolution.height, i);
+	}
+
+	Encoder* encoder = new Encoder();
+	encoder->set_width(resolution.width);
+	encoder->set_height(resolution.height);
+	encoder->set_bytepixel(4);
+	encoder->set_fps(fps);
+	encoder->set_bitrate(bitrate);
+	encoder->set_mode(mode);
+	if (encoder->initialize() < 0)
+	{
+		fprintf(stderr, "cannot initialize encoder\n");
+		delete encoder;
+		return;
+	}
+
+	std::vector<int64_t> samples_ns;
+	samples_ns.reserve(frame_count);
+	FrameInfo info = {};
+	info.region_count = -1;
+
+	std::chrono::steady_clock::time_point t_run = std::chrono::steady_clock::now();
+	for (int32_t i = 0; i < frame_count; i++)
+	{
+		info.pts = i;
+		info.capture_us = (int64_t)i * 1000000 / fps;
+
+		std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+		if (encoder->encode_frame(frames.data() + frame_length * (i % distinct_frames), info) < 0)
+		{
+			fprintf(stderr, "encode_frame error\n");
+			break;
+		}
+		samples_ns.push_back(elapsed_ns(t_start));
+	}
+
+	std::chrono::steady_clock::time_point t_flush = std::chrono::steady_clock::now();
+	encoder->output_close();
+	int64_t flush_ns = elapsed_ns(t_flush);
+	int64_t run_ns = elapsed_ns(t_run);
+
+	char extra[512];
+	snprintf(extra, sizeof(extra),
+		"\"mode\":\"%s\",\"fps\":%.2f,\"flush_ns\":%lld,\"bitrate\":%d,\"average_bitrate\":%lld,"
+		"\"submitted_frames\":%lld,\"encoded_packets\":%lld,\"encoded_bytes\":%lld,\"packets_match\":%s",
+		Encoder::get_mode_name(mode), run_ns > 0 ? frame_count * 1000000000.0 / run_ns : 0.0, (long long)flush_ns, bitrate,
+		(long long)encoder->get_average_bitrate(), (long long)encoder->get_submitted_frames(), (long long)encoder->get_encoded_packets(),
+		(long long)encoder->get_encoded_bytes(), encoder->get_submitted_frames() == encoder->get_encoded_packets() ? "true" : "false");
+
+	std::string name = std::string("encode_") + Encoder::get_mode_name(mode);
+	add_result(name.c_str(), resolution, samples_ns, frame_length, extra);
+
+	delete encoder;
+}
+
+// the same pictures encoded at constant quality without and then with region of interest offsets, the block
+// fill_frame moved is reported as the changed region of every frame, samples are taken from the run with offsets
+static void bench_roi(const BenchmarkOptions& options, const Resolution& resolution)
+{
+	const int32_t fps = 30;
+	int32_t frame_count = options.encode_frames;
+	int64_t frame_length = (int64_t)resolution.width * resolution.height * 4;
+
+	const int32_t distinct_frames = 8;
+	std::vector<uint8_t> frames(frame_length * distinct_frames);
+	for (int32_t i = 0; i < distinct_frames; i++)
+	{
+		fill_frame(frames.data() + frame_length * i, resolution.width, resolution.height, i);
+	}
+
+	int64_t encoded_bytes[2] = { 0, 0 };
+	std::vector<int64_t> samples_ns;
+	samples_ns.reserve(frame_count);
+
+	for (int32_t roi = 0; roi < 2; roi++)
+	{
+		Encoder* encoder = new Encoder();
+		encoder->set_width(resolution.width);
+		encoder->set_height(resolution.height);
+		encoder->set_bytepixel(4);
+		encoder->set_fps(fps);
+		// a bitrate target would spend the bytes the offsets save elsewhere
+		encoder->set_rate_control(RATE_CONTROL_CRF);
+		encoder->set_roi(roi != 0);
+		if (encoder->initialize() < 0)
+		{
+			fprintf(stderr, "cannot initialize encoder\n");
+			delete encoder;
+			return;
+		}
+
+		FrameInfo info = {};
+		for (int32_t i = 0; i < frame_count; i++)
+		{
+			info.pts = i;
+			info.capture_us = (int64_t)i * 1000000 / fps;
+			// the block left its previous place and appeared at the new one
+			info.region_count = 0;
+			add_frame_region(info.regions, &info.region_count, block_region(resolution.width, resolution.height, (i + distinct_frames - 1) % distinct_frames));
+			add_frame_region(info.regions, &info.region_count, block_region(resolution.width, resolution.height, i % distinct_frames));
+
+			std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+			if (encoder->encode_frame(frames.data() + frame_length * (i % distinct_frames), info) < 0)
+			{
+				fprintf(stderr, "encode_frame error\n");
+				break;
+			}
+			if (roi)
+			{
+				samples_ns.push_back(elapsed_ns(t_start));
+			}
+		}
+
+		encoder->output_close();
+		encoded_bytes[roi] = encoder->get_encoded_bytes();
+
+		delete encoder;
+	}
+
+	char extra[256];
+	snprintf(extra, sizeof(extra), "\"encoded_bytes_without_roi\":%lld,\"encoded_bytes_with_roi\":%lld,\"roi_bytes_ratio\":%.3f",
+		(long long)encoded_bytes[0], (long long)encoded_bytes[1], encoded_bytes[0] > 0 ? (double)encoded_bytes[1] / encoded_bytes[0] : 0.0);
+	add_result("encode_roi", resolution, samples_ns, frame_length, extra);
+
+	fprintf(stderr, "%-22s %-6s %lld bytes without roi, %lld bytes with roi\n", "encode_roi", resolution.name,
+		(long long)encoded_bytes[0], (long long)encoded_bytes[1]);
+}
+
+static bool parse_resolutions(const char* value, std::vector<Resolution>* list)
+{
+	list->clear();
+
+	return parse_list(value, [list](const std::string& name) {
+		for (const Resolution& resolution : resolutions)
+		{
+			if (name == resolution.name)
+			{
+				list->push_back(resolution);
+				return true;
+			}
+		}
+		return false;
+		});
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	std::string output;
+	int exit_code = 0;
+
+	options.resolutions.assign(resolutions, resolutions + sizeof(resolutions) / sizeof(resolutions[0]));
+	options.iterations = 200;
+	options.encode_frames = 120;
+	options.verbose = false;
+
+	if (argc > 1 && strcmp(argv[1], "pipeline") == 0)
+	{
+		return pipeline_main(argc - 1, argv + 1);
+	}
+	if (argc > 1 && strcmp(argv[1], "probe") == 0)
+	{
+		return probe_main(argc - 1, argv + 1);
+	}
+	if (argc > 1 && strcmp(argv[1], "stress") == 0)
+	{
+		return stress_main(argc - 1, argv + 1);
+	}
+	if (argc > 1 && strcmp(argv[1], "disk") == 0)
+	{
+		return disk_main(argc - 1, argv + 1);
+	}
+	if (argc > 1 && strcmp(argv[1], "pacer") == 0)
+	{
+		return pacer_main(argc - 1, argv + 1);
+	}
+
+	std::vector<BenchmarkOption> command_options =
+	{
+		string_option("--output", &output),
+		string_option("--filter", &options.filter),
+		{ "--resolutions", false, [&](const char* value) { return parse_resolutions(value, &options.resolutions); } },
+		int_option("--iterations", &options.iterations),
+		int_option("--encode-frames", &options.encode_frames),
+		flag_option("--verbose", &options.verbose),
+	};
+	if (!parse_options(argc, argv, command_options, usage, &exit_code))
+	{
+		return exit_code;
+	}
+
+	recorder_set_log_callback(on_log, &options.verbose);
+
+	for (const Resolution& resolution : options.resolutions)
+	{
+		if (selected(options, "copy")) bench_copy(options, resolution);
+		if (selected(options, "compact_padded") || selected(options, "compact_contiguous")) bench_compact(options, resolution);
+		if (selected(options, "convert") || selected(options, "convert_scaled")) bench_convert(options, resolution);
+		if (selected(options, "regions")) bench_regions(options, resolution);
+		for (int32_t mode = ENCODER_MODE_LOW_LATENCY; mode <= ENCODER_MODE_ARCHIVAL; mode++)
+		{
+			std::string name = std::string("encode_") + Encoder::get_mode_name((EncoderMode)mode);
+			if (selected(options, name.c_str())) bench_encode(options, resolution, (EncoderMode)mode);
+		}
+		if (selected(options, "encode_roi")) bench_roi(options, resolution);
+	}
+
+	return write_results(output, "", results) < 0 ? 1 : 0;
+}
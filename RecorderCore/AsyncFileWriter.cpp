@@ -0,0 +1,490 @@
+#include "pch.h"
+#include "AsyncFileWriter.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+static uint8_t* aligned_alloc_buffer(size_t size)
+{
+#ifdef _WIN32
+	return reinterpret_cast<uint8_t*>(_aligned_malloc(size, WRITE_BUFFER_ALIGNMENT));
+#else
+	void* buffer = nullptr;
+	return posix_memalign(&buffer, WRITE_BUFFER_ALIGNMENT, size) == 0 ? reinterpret_cast<uint8_t*>(buffer) : nullptr;
+#endif
+}
+
+static void aligned_free_buffer(uint8_t* buffer)
+{
+#ifdef _WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+AsyncFileWriter::AsyncFileWriter() :
+#ifdef _WIN32
+	m_file(INVALID_HANDLE_VALUE),
+	m_direct_file(INVALID_HANDLE_VALUE),
+#else
+	m_file(-1),
+	m_direct_file(-1),
+#endif
+	m_direct(false),
+	m_avio(nullptr),
+	m_stats(nullptr),
+	m_write_rate(0),
+	m_pending_head(0),
+	m_pending_count(0),
+	m_current(-1),
+	m_buffer_size(0),
+	m_position(0),
+	m_size(0),
+	m_running(false),
+	m_error(false),
+	m_stalls(0),
+	m_stall_us(0),
+	m_max_write_us(0)
+{
+
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+	close();
+
+	for (auto& buffer : m_buffers)
+	{
+		aligned_free_buffer(buffer.data);
+	}
+	m_buffers.clear();
+}
+
+int32_t AsyncFileWriter::open(const char* filename, int32_t buffer_size, int32_t buffer_count, int64_t preallocate)
+{
+	uint8_t* avio_buffer = nullptr;
+
+	if (buffer_size <= 0 || buffer_count <= 0)
+	{
+		TRACE(_T("write buffer size invalid\n"));
+		return -1;
+	}
+
+	// whole pages, a buffer started on a page boundary ends on one
+	m_buffer_size = (buffer_size + WRITE_BUFFER_ALIGNMENT - 1) / WRITE_BUFFER_ALIGNMENT * WRITE_BUFFER_ALIGNMENT;
+	for (int32_t i = 0; i < buffer_count; i++)
+	{
+		WriteBuffer buffer = { aligned_alloc_buffer(m_buffer_size), 0, 0, 0 };
+		if (!buffer.data)
+		{
+			TRACE(_T("cannot allocate write buffer\n"));
+			return -1;
+		}
+		m_buffers.push_back(buffer);
+		m_free.push_back(i);
+	}
+	m_pending.resize(buffer_count);
+
+	if (file_open(filename, preallocate) < 0)
+	{
+		TRACE(_T("cannot open output file\n"));
+		return -1;
+	}
+
+	// small staging buffer of libavformat, flushed into our write buffers
+	avio_buffer = reinterpret_cast<uint8_t*>(av_malloc(AVIO_BUFFER_SIZE));
+	if (!avio_buffer)
+	{
+		TRACE(_T("cannot allocate avio buffer\n"));
+		return -1;
+	}
+
+	m_avio = avio_alloc_context(avio_buffer, AVIO_BUFFER_SIZE, 1, this, nullptr, write_callback, seek_callback);
+	if (!m_avio)
+	{
+		av_free(avio_buffer);
+		TRACE(_T("cannot allocate avio context\n"));
+		return -1;
+	}
+
+	m_running = true;
+	m_writer_thread = std::move(std::thread([=]() {
+		writer_thread();
+		}));
+
+	return 0;
+}
+
+int32_t AsyncFileWriter::close()
+{
+	if (!m_avio)
+	{
+		file_close();
+		return 0;
+	}
+
+	avio_flush(m_avio);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		submit_buffer();
+		m_running = false;
+	}
+	m_cond.notify_all();
+
+	// writer finishes every pending buffer before it exits
+	if (m_writer_thread.joinable())
+	{
+		m_writer_thread.join();
+	}
+
+	av_freep(&m_avio->buffer);
+	avio_context_free(&m_avio);
+	file_close();
+
+	TRACE(_T("async writer : %lld bytes, %lld stalls (%lld us), slowest write %lld us\n"),
+		(long long)m_size, (long long)m_stalls.load(), (long long)m_stall_us.load(), (long long)m_max_write_us.load());
+
+	return m_error ? -1 : 0;
+}
+
+int AsyncFileWriter::write_callback(void* opaque, uint8_t* buf, int buf_size)
+{
+	return reinterpret_cast<AsyncFileWriter*>(opaque)->write(buf, buf_size);
+}
+
+int64_t AsyncFileWriter::seek_callback(void* opaque, int64_t offset, int whence)
+{
+	return reinterpret_cast<AsyncFileWriter*>(opaque)->seek(offset, whence);
+}
+
+int32_t AsyncFileWriter::write(const uint8_t* data, int32_t size)
+{
+	int32_t written = 0;
+
+	if (m_error)
+	{
+		return AVERROR(EIO);
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (written < size)
+	{
+		if (m_current < 0)
+		{
+			if (m_free.empty())
+			{
+				// every buffer is in flight, the disk is slower than the encoder
+				std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+				m_cond.wait(lock, [=]() { return !m_free.empty() || m_error; });
+				m_stalls++;
+				m_stall_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+				if (m_error)
+				{
+					return AVERROR(EIO);
+				}
+			}
+			m_current = acquire_buffer();
+		}
+
+		WriteBuffer& buffer = m_buffers[m_current];
+		int32_t length = size - written;
+		if (length > m_buffer_size - buffer.start - buffer.size) length = m_buffer_size - buffer.start - buffer.size;
+		memcpy(buffer.data + buffer.start + buffer.size, data + written, length);
+		buffer.size += length;
+		written += length;
+		m_position += length;
+		if (m_position > m_size) m_size = m_position;
+
+		if (buffer.start + buffer.size == m_buffer_size)
+		{
+			submit_buffer();
+		}
+	}
+
+	return size;
+}
+
+int64_t AsyncFileWriter::seek(int64_t offset, int whence)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	switch (whence)
+	{
+	case AVSEEK_SIZE:
+		return m_size;
+	case SEEK_SET:
+		break;
+	case SEEK_CUR:
+		offset += m_position;
+		break;
+	case SEEK_END:
+		offset += m_size;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (offset < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	// data before the seek is queued first, a rewrite of an earlier range is written after it
+	submit_buffer();
+	m_position = offset;
+
+	return offset;
+}
+
+int32_t AsyncFileWriter::acquire_buffer()
+{
+	int32_t index = m_free.back();
+	m_free.pop_back();
+
+	// after a seek the data starts where the file position falls in its page, later buffers start on a page
+	m_buffers[index].start = m_direct ? (int32_t)(m_position % WRITE_BUFFER_ALIGNMENT) : 0;
+	m_buffers[index].size = 0;
+	m_buffers[index].offset = m_position;
+
+	return index;
+}
+
+void AsyncFileWriter::submit_buffer()
+{
+	if (m_current < 0)
+	{
+		return;
+	}
+
+	if (m_buffers[m_current].size == 0)
+	{
+		m_free.push_back(m_current);
+	}
+	else
+	{
+		m_pending[(m_pending_head + m_pending_count) % (int32_t)m_pending.size()] = m_current;
+		m_pending_count++;
+		if (m_stats) m_stats->set_write_queue_depth(m_pending_count);
+	}
+	m_current = -1;
+
+	m_cond.notify_all();
+}
+
+void AsyncFileWriter::writer_thread()
+{
+	Tracer::set_thread_name("writer");
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		m_cond.wait(lock, [=]() { return m_pending_count > 0 || !m_running; });
+		if (m_pending_count == 0)
+		{
+			break;
+		}
+
+		// buffers are written one at a time in submit order
+		int32_t index = m_pending[m_pending_head];
+		WriteBuffer buffer = m_buffers[index];
+		lock.unlock();
+
+		std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+		int32_t ret = m_error ? -1 : write_buffer(buffer);
+		if (m_write_rate > 0)
+		{
+			std::this_thread::sleep_until(t_start + std::chrono::microseconds((int64_t)buffer.size * 1000000 / m_write_rate));
+		}
+		int64_t write_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+		if (write_us > m_max_write_us) m_max_write_us = write_us;
+		if (m_stats)
+		{
+			m_stats->add_stage(PIPELINE_STAGE_WRITE, t_start);
+			if (ret >= 0) m_stats->add_bytes_written(buffer.size);
+		}
+
+		lock.lock();
+		if (ret < 0 && !m_error)
+		{
+			TRACE(_T("cannot write output file\n"));
+			m_error = true;
+		}
+		m_pending_head = (m_pending_head + 1) % (int32_t)m_pending.size();
+		m_pending_count--;
+		m_free.push_back(index);
+		if (m_stats) m_stats->set_write_queue_depth(m_pending_count);
+		m_cond.notify_all();
+	}
+}
+
+int32_t AsyncFileWriter::write_buffer(const WriteBuffer& buffer)
+{
+	const uint8_t* data = buffer.data + buffer.start;
+
+	if (!m_direct)
+	{
+		return file_write(false, data, buffer.size, buffer.offset);
+	}
+
+	// up to the first page boundary, the whole pages, then what is left of the last page
+	int32_t head = buffer.start > 0 ? WRITE_BUFFER_ALIGNMENT - buffer.start : 0;
+	if (head > buffer.size) head = buffer.size;
+	int32_t pages = (buffer.size - head) / WRITE_BUFFER_ALIGNMENT * WRITE_BUFFER_ALIGNMENT;
+	int32_t tail = buffer.size - head - pages;
+
+	if (head > 0 && file_write(false, data, head, buffer.offset) < 0)
+	{
+		return -1;
+	}
+	if (pages > 0 && file_write(true, data + head, pages, buffer.offset + head) < 0)
+	{
+		// a device with larger sectors than the alignment, the rest of the file goes through the cache
+		TRACE(_T("unbuffered write failed, writing through the cache\n"));
+		m_direct = false;
+		if (file_write(false, data + head, pages, buffer.offset + head) < 0)
+		{
+			return -1;
+		}
+	}
+	if (tail > 0 && file_write(false, data + head + pages, tail, buffer.offset + head + pages) < 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef _WIN32
+int32_t AsyncFileWriter::file_open(const char* filename, int64_t preallocate)
+{
+	m_file = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return -1;
+	}
+
+	// second handle for the whole pages, the cached one keeps the partial pages and the end of file
+	m_direct_file = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+	m_direct = m_direct_file != INVALID_HANDLE_VALUE;
+	if (!m_direct)
+	{
+		TRACE(_T("unbuffered writes unavailable, writing through the file cache\n"));
+	}
+
+	// reserves clusters up front, the end of file still follows what is written
+	if (preallocate > 0)
+	{
+		FILE_ALLOCATION_INFO allocation = {};
+		allocation.AllocationSize.QuadPart = preallocate;
+		if (!SetFileInformationByHandle(m_file, FileAllocationInfo, &allocation, sizeof(allocation)))
+		{
+			TRACE(_T("cannot preallocate output file\n"));
+		}
+	}
+
+	return 0;
+}
+
+int32_t AsyncFileWriter::file_write(bool direct, const uint8_t* data, int32_t size, int64_t offset)
+{
+	DWORD written = 0;
+
+	// offset given through OVERLAPPED, the handle itself is synchronous
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	if (!WriteFile(direct ? m_direct_file : m_file, data, size, &written, &overlapped) || written != (DWORD)size)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+void AsyncFileWriter::file_close()
+{
+	if (m_direct_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_direct_file);
+		m_direct_file = INVALID_HANDLE_VALUE;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	m_direct = false;
+}
+#else
+int32_t AsyncFileWriter::file_open(const char* filename, int64_t preallocate)
+{
+	m_file = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (m_file < 0)
+	{
+		return -1;
+	}
+
+#ifdef FALLOC_FL_KEEP_SIZE
+	// reserves blocks up front, the file size still follows what is written
+	if (preallocate > 0 && fallocate(m_file, FALLOC_FL_KEEP_SIZE, 0, preallocate) < 0)
+	{
+		TRACE(_T("cannot preallocate output file\n"));
+	}
+#endif
+
+#ifdef O_DIRECT
+	// second descriptor for the whole pages, the buffered one keeps the partial pages and the end of file
+	m_direct_file = ::open(filename, O_WRONLY | O_DIRECT);
+#endif
+	m_direct = m_direct_file >= 0;
+	if (!m_direct)
+	{
+		TRACE(_T("unbuffered writes unavailable, writing through the page cache\n"));
+	}
+
+	return 0;
+}
+
+int32_t AsyncFileWriter::file_write(bool direct, const uint8_t* data, int32_t size, int64_t offset)
+{
+	while (size > 0)
+	{
+		ssize_t written = pwrite(direct ? m_direct_file : m_file, data, size, offset);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		data += written;
+		size -= (int32_t)written;
+		offset += written;
+	}
+
+	return 0;
+}
+
+void AsyncFileWriter::file_close()
+{
+	if (m_direct_file >= 0)
+	{
+		::close(m_direct_file);
+		m_direct_file = -1;
+	}
+	if (m_file >= 0)
+	{
+		::close(m_file);
+		m_file = -1;
+	}
+	m_direct = false;
+}
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PipelineStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define WRITE_BUFFER_ALIGNMENT 4096
+#define AVIO_BUFFER_SIZE (64 * 1024)
+
+// file behind an AVIOContext, writes are gathered in large aligned buffers and written out by a dedicated thread,
+// the caller only waits when every buffer is still in flight. Whole pages bypass the page cache where the
+// file system allows it, a partial page at either end of a buffer is written through the cache.
+class AsyncFileWriter
+{
+public:
+	AsyncFileWriter();
+	~AsyncFileWriter();
+
+	// disk writes and the number of buffers waiting for them are reported to stats, nullptr to disable
+	void set_stats(PipelineStats* stats) { m_stats = stats; }
+	// slows every buffer write down to bytes_per_second to stand in for a slow disk, 0 for full speed
+	void set_write_rate(int64_t bytes_per_second) { m_write_rate = bytes_per_second; }
+
+	// preallocate reserves disk space without changing the file size, 0 to skip
+	int32_t open(const char* filename, int32_t buffer_size, int32_t buffer_count, int64_t preallocate);
+	int32_t close();
+
+	AVIOContext* get_avio() { return m_avio; }
+	int64_t get_stalls() { return m_stalls; }
+	int64_t get_stall_us() { return m_stall_us; }
+	int64_t get_max_write_us() { return m_max_write_us; }
+
+private:
+	struct WriteBuffer
+	{
+		uint8_t* data;
+		int32_t start;		// first used byte, the file offset modulo the alignment so pages line up with the file
+		int32_t size;
+		int64_t offset;		// file offset of data[start]
+	};
+
+	static int write_callback(void* opaque, uint8_t* buf, int buf_size);
+	static int64_t seek_callback(void* opaque, int64_t offset, int whence);
+	int32_t write(const uint8_t* data, int32_t size);
+	int64_t seek(int64_t offset, int whence);
+	int32_t acquire_buffer();
+	void submit_buffer();
+	void writer_thread();
+	int32_t write_buffer(const WriteBuffer& buffer);
+
+	// platform file access, writes are positioned so the order of buffers alone decides the content,
+	// direct writes go through the unbuffered handle and must cover whole aligned pages
+	int32_t file_open(const char* filename, int64_t preallocate);
+	int32_t file_write(bool direct, const uint8_t* data, int32_t size, int64_t offset);
+	void file_close();
+
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_direct_file;	// INVALID_HANDLE_VALUE when the volume refuses unbuffered access
+#else
+	int m_file;
+	int m_direct_file;		// -1 when the file system refuses O_DIRECT
+#endif
+	std::atomic<bool> m_direct;
+	AVIOContext* m_avio;
+	PipelineStats* m_stats;
+	int64_t m_write_rate;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::vector<WriteBuffer> m_buffers;
+	std::vector<int32_t> m_free;		// unused buffer indexes
+	std::vector<int32_t> m_pending;		// ring of buffers waiting for the writer, in submit order
+	int32_t m_pending_head;
+	int32_t m_pending_count;
+	int32_t m_current;					// buffer being filled, -1 for none
+	int32_t m_buffer_size;
+	int64_t m_position;
+	int64_t m_size;
+	bool m_running;
+	std::atomic<bool> m_error;
+	std::thread m_writer_thread;
+
+	std::atomic<int64_t> m_stalls;
+	std::atomic<int64_t> m_stall_us;
+	std::atomic<int64_t> m_max_write_us;
+};
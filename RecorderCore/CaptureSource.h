@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "FrameInfo.h"
+#include "PipelineStats.h"
+
+// a producer of raw BGRA frames, the source signals new content and the record thread polls for it on its frame tick
+class CaptureSource
+{
+public:
+	CaptureSource() :
+		m_stats(nullptr),
+		m_frame_sequence(0),
+		m_signal_us(0),
+		m_wakeups(0)
+	{
+	}
+	virtual ~CaptureSource() {}
+
+	virtual int32_t get_width() = 0;
+	virtual int32_t get_height() = 0;
+	virtual int32_t get_bytepixel() = 0;
+	virtual int32_t get_frame_buffer_length() = 0;
+	// copies the latest frame into buffer, info receives the regions changed since the previous call
+	virtual int32_t get_frame_data(uint8_t* buffer, FrameInfo* info = nullptr) = 0;
+
+	virtual void start_capture() = 0;
+	virtual void stop_capture() = 0;
+
+	// the time taken to read each new picture is reported as the acquire stage, nullptr to disable
+	void set_stats(PipelineStats* stats) { m_stats = stats; }
+
+	// bumped on every new picture, 0 until the first one
+	int64_t get_frame_sequence() { return m_frame_sequence; }
+	// steady clock time of the latest new picture in microseconds
+	int64_t get_signal_us() { return m_signal_us; }
+	// capture thread wakeups, with or without new content
+	int64_t get_wakeups() { return m_wakeups; }
+
+protected:
+	// called by the capture thread once the new picture is readable through get_frame_data
+	void signal_frame()
+	{
+		// time first, a reader that sees the new sequence never pairs it with the previous picture's time
+		m_signal_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		m_frame_sequence++;
+	}
+
+	void count_wakeup() { m_wakeups++; }
+
+	PipelineStats* m_stats;
+
+private:
+	std::atomic<int64_t> m_frame_sequence;
+	std::atomic<int64_t> m_signal_us;
+	std::atomic<int64_t> m_wakeups;
+};
@@ -1,8 +1,11 @@
 #include "pch.h"
 #include "Duplicator.h"
+#include "FrameKernels.h"
 
+#ifdef _MSC_VER
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
+#endif
 
 Duplicator::Duplicator()
 {
@@ -10,6 +13,7 @@ Duplicator::Duplicator()
     m_Context = nullptr;
     m_DeskDupl = nullptr;
     m_AcquiredDesktopImage = nullptr;
+    m_StagingTexture = nullptr;
 
     ZeroMemory(&m_DesktopDesc, sizeof(DXGI_OUTPUT_DESC));
     ZeroMemory(&m_DuplicationDesc, sizeof(DXGI_OUTDUPL_DESC));
@@ -21,11 +25,17 @@ Duplicator::Duplicator()
     m_frame_buffer = nullptr;
     m_capture_running = false;
     m_fps = 0;
+
+    m_metadata_buffer = nullptr;
+    m_metadata_size = 0;
+    m_region_count = -1;
+    m_cursor_visible = false;
+    m_cursor_position = { 0, 0 };
 }
 
 Duplicator::~Duplicator()
 {
-    stop_duplicate();
+    stop_capture();
 
     if (m_frame_buffer)
     {
@@ -33,12 +43,24 @@ Duplicator::~Duplicator()
         m_frame_buffer = nullptr;
     }
 
+    if (m_metadata_buffer)
+    {
+        delete[] m_metadata_buffer;
+        m_metadata_buffer = nullptr;
+    }
+
     if (m_AcquiredDesktopImage)
     {
         m_AcquiredDesktopImage->Release();
         m_AcquiredDesktopImage = nullptr;
     }
 
+    if (m_StagingTexture)
+    {
+        m_StagingTexture->Release();
+        m_StagingTexture = nullptr;
+    }
+
     if (m_DeskDupl)
     {
         m_DeskDupl->Release();
@@ -96,7 +118,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     }
     if (FAILED(hr))
     {
-        TRACE(_T("Failed to create device in InitializeDx hr: 0x%x\n"), hr);
+        TRACE(_T("Failed to create device in InitializeDx hr: 0x%x\n"), (unsigned int)hr);
         return hr;
     }
 
@@ -105,7 +127,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     hr = m_Device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&DxgiDevice));
     if (FAILED(hr))
     {
-        TRACE(_T("Failed to QI for DXGI Device hr: 0x%x\n"), hr);
+        TRACE(_T("Failed to QI for DXGI Device hr: 0x%x\n"), (unsigned int)hr);
         return hr;
     }
 
@@ -116,7 +138,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     DxgiDevice = nullptr;
     if (FAILED(hr))
     {
-        TRACE(_T("Failed to get parent DXGI Adapter hr: 0x%x\n"), hr);
+        TRACE(_T("Failed to get parent DXGI Adapter hr: 0x%x\n"), (unsigned int)hr);
         return hr;
     }
 
@@ -145,7 +167,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     DxgiAdapter = nullptr;
     if (FAILED(hr))
     {
-        TRACE(_T("cannot found matched target display hr: 0x%x\n"), hr);
+        TRACE(_T("cannot found matched target display hr: 0x%x\n"), (unsigned int)hr);
         return hr;
     }
 
@@ -156,7 +178,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     DxgiOutput = nullptr;
     if (FAILED(hr))
     {
-        TRACE(_T("Failed to QI for DxgiOutput1 hr: 0x%x\n"), hr);
+        TRACE(_T("Failed to QI for DxgiOutput1 hr: 0x%x\n"), (unsigned int)hr);
         return hr;
     }
 
@@ -166,7 +188,7 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
     DxgiOutput1 = nullptr;
     if (FAILED(hr))
     {
-        TRACE(_T("Failed to get duplicate output hr: 0x%x\n"), hr);
+        TRACE(_T("Failed to get duplicate output hr: 0x%x\n"), (unsigned int)hr);
         if (hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
         {
             TRACE(_T("There is already the maximum number of applications using the Desktop Duplication API running, please close one of those applications and then try again.\n"));
@@ -186,14 +208,14 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
 
     TRACE(_T("initialize success\n"));
     TRACE(_T("output description\n"));
-    TRACE(_T("\tdevice name: %ws\n"), m_DesktopDesc.DeviceName);
-    TRACE(_T("\ttcoordinates: (%d x %d) - (%d x %d)\n"), m_DesktopDesc.DesktopCoordinates.left, m_DesktopDesc.DesktopCoordinates.top,
+    TRACE(_T("\tdevice name: %ls\n"), m_DesktopDesc.DeviceName);
+    TRACE(_T("\ttcoordinates: (%ld x %ld) - (%ld x %ld)\n"), m_DesktopDesc.DesktopCoordinates.left, m_DesktopDesc.DesktopCoordinates.top,
         m_DesktopDesc.DesktopCoordinates.right, m_DesktopDesc.DesktopCoordinates.bottom);
     TRACE(_T("duplication description\n"));
     TRACE(_T("\tsize: %d x %d\n"), m_width, m_height);
     TRACE(_T("\tbyte pixel: %d\n"), m_bytepixel);
-    TRACE(_T("\tformat: %hs\n"), get_duplicate_format(m_DuplicationDesc.ModeDesc.Format));
-    TRACE(_T("\trotation: %hs\n"), get_duplicate_rotation(m_DuplicationDesc.Rotation));
+    TRACE(_T("\tformat: %s\n"), get_duplicate_format(m_DuplicationDesc.ModeDesc.Format));
+    TRACE(_T("\trotation: %s\n"), get_duplicate_rotation(m_DuplicationDesc.Rotation));
 
     return hr;
 }
@@ -201,38 +223,54 @@ HRESULT Duplicator::initialize(const wchar_t* target_display, int32_t fps)
 void Duplicator::desktop_duplication_thread()
 {
     HRESULT hr;
+    bool frame_acquired = false;
 
-    std::chrono::high_resolution_clock::time_point t_start, t_done;
-    std::chrono::microseconds t_spend;
-    int64_t frame_us = (1 * 1000 * 1000) / (m_fps * 2); // doubling frames per seconds
+    Tracer::set_thread_name("capture");
 
     IDXGIResource* DesktopResource = NULL;
     ID3D11Texture2D* pAcquiredDesktopImage = NULL;
-    DXGI_OUTDUPL_FRAME_INFO FrameInfo;
+    DXGI_OUTDUPL_FRAME_INFO DuplFrameInfo;
 
     while (m_capture_running)
     {
-        t_start = std::chrono::high_resolution_clock::now();
-
-        hr = m_DeskDupl->ReleaseFrame();
-        if (FAILED(hr))
+        // the frame is held until just before the next acquire, as the duplication API expects
+        if (frame_acquired)
         {
-            TRACE(_T("Failed to release frame hr: 0x%x\n"), hr);
+            hr = m_DeskDupl->ReleaseFrame();
+            if (FAILED(hr))
+            {
+                TRACE(_T("Failed to release frame hr: 0x%x\n"), (unsigned int)hr);
+            }
+            frame_acquired = false;
         }
 
-        // Get new frame
-        hr = m_DeskDupl->AcquireNextFrame(INFINITE, &FrameInfo, &DesktopResource);
+        // blocks until the desktop changes, the timeout only bounds how long a stop request waits
+        hr = m_DeskDupl->AcquireNextFrame(DUPLICATOR_ACQUIRE_TIMEOUT_MS, &DuplFrameInfo, &DesktopResource);
+        count_wakeup();
         if (hr == DXGI_ERROR_WAIT_TIMEOUT)
         {
-            TRACE(_T("AcquireNextFrame timed out\n"));
-            break;
+            continue;
         }
 
         if (FAILED(hr))
         {
-            TRACE(_T("Failed to acquire next frame hr: 0x%x\n"), hr);
+            TRACE(_T("Failed to acquire next frame hr: 0x%x\n"), (unsigned int)hr);
             break;
         }
+        frame_acquired = true;
+        std::chrono::steady_clock::time_point t_acquire = std::chrono::steady_clock::now();
+
+        // pointer only updates carry no new picture, keep the regions and skip the copy
+        if (DuplFrameInfo.LastPresentTime.QuadPart == 0)
+        {
+            DesktopResource->Release();
+            DesktopResource = nullptr;
+
+            m_mutex.lock();
+            update_regions(&DuplFrameInfo);
+            m_mutex.unlock();
+            continue;
+        }
 
         // If still holding old frame, destroy it
         if (pAcquiredDesktopImage)
@@ -247,34 +285,49 @@ void Duplicator::desktop_duplication_thread()
         DesktopResource = nullptr;
         if (FAILED(hr))
         {
-            TRACE(_T("Failed to QI for ID3D11Texture2D from acquired IDXGIResource hr: 0x%x\n"), hr);
+            TRACE(_T("Failed to QI for ID3D11Texture2D from acquired IDXGIResource hr: 0x%x\n"), (unsigned int)hr);
             break;
         }
 
         D3D11_TEXTURE2D_DESC desc;
         pAcquiredDesktopImage->GetDesc(&desc);
 
-        D3D11_TEXTURE2D_DESC desc2;
-        desc2.Width = desc.Width;
-        desc2.Height = desc.Height;
-        desc2.MipLevels = 1;
-        desc2.ArraySize = 1;
-        desc2.Format = desc.Format;
-        desc2.SampleDesc.Count = 1;
-        desc2.SampleDesc.Quality = 0;
-        desc2.Usage = D3D11_USAGE_STAGING;
-        desc2.BindFlags = 0;
-        desc2.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-        desc2.MiscFlags = 0;
-
-        ID3D11Texture2D* texture;
-        hr = m_Device->CreateTexture2D(&desc2, nullptr, &texture);
-        if (FAILED(hr))
+        // staging texture is reused until the desktop size or format changes
+        if (m_StagingTexture)
         {
-            TRACE(_T("Failed to create staging texture hr: 0x%x\n"), hr);
-            break;
+            D3D11_TEXTURE2D_DESC staging_desc;
+            m_StagingTexture->GetDesc(&staging_desc);
+            if (staging_desc.Width != desc.Width || staging_desc.Height != desc.Height || staging_desc.Format != desc.Format)
+            {
+                m_StagingTexture->Release();
+                m_StagingTexture = nullptr;
+            }
         }
 
+        if (!m_StagingTexture)
+        {
+            D3D11_TEXTURE2D_DESC desc2;
+            desc2.Width = desc.Width;
+            desc2.Height = desc.Height;
+            desc2.MipLevels = 1;
+            desc2.ArraySize = 1;
+            desc2.Format = desc.Format;
+            desc2.SampleDesc.Count = 1;
+            desc2.SampleDesc.Quality = 0;
+            desc2.Usage = D3D11_USAGE_STAGING;
+            desc2.BindFlags = 0;
+            desc2.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            desc2.MiscFlags = 0;
+
+            hr = m_Device->CreateTexture2D(&desc2, nullptr, &m_StagingTexture);
+            if (FAILED(hr))
+            {
+                TRACE(_T("Failed to create staging texture hr: 0x%x\n"), (unsigned int)hr);
+                break;
+            }
+        }
+        ID3D11Texture2D* texture = m_StagingTexture;
+
         // copy the texture to a staging resource
         m_Context->CopyResource(texture, pAcquiredDesktopImage);
         pAcquiredDesktopImage->Release();
@@ -286,40 +339,33 @@ void Duplicator::desktop_duplication_thread()
         hr = m_Context->Map(texture, subresource, D3D11_MAP_READ, 0, &mapInfo);
         if (FAILED(hr))
         {
-            TRACE(_T("Failed to map texture hr: 0x%x\n"), hr);
+            TRACE(_T("Failed to map texture hr: 0x%x\n"), (unsigned int)hr);
             break;
         }
 
         m_mutex.lock();
+        update_regions(&DuplFrameInfo);
         if (m_frame_buffer)
         {
-            // copy texture to bitmap buffer
-            unsigned char* dst_buffer = m_frame_buffer;
-            unsigned char* src_buffer = reinterpret_cast<unsigned char*>(mapInfo.pData);
-            for (int row = 0; row < m_height; row++)
-            {
-                memcpy(dst_buffer, src_buffer, ((uint64_t)m_width * m_bytepixel));
-                dst_buffer += ((uint64_t)m_width * m_bytepixel);
-                src_buffer += mapInfo.RowPitch;
-            }
+            // copy texture to bitmap buffer, rows of the staging texture are padded to RowPitch
+            copy_rows(m_frame_buffer, reinterpret_cast<uint8_t*>(mapInfo.pData), mapInfo.RowPitch,
+                (int64_t)m_width * m_bytepixel, m_height);
         }
         m_mutex.unlock();
 
         m_Context->Unmap(texture, subresource);
 
-        texture->Release();
-        texture = nullptr;
+        if (m_stats) m_stats->add_stage(PIPELINE_STAGE_ACQUIRE, t_acquire, get_frame_sequence() + 1);
+        signal_frame();
+    }
 
-        t_done = std::chrono::high_resolution_clock::now();
-        t_spend = std::chrono::duration_cast<std::chrono::microseconds>(t_done - t_start);
-        if (t_spend.count() < frame_us)
-        {
-            std::this_thread::sleep_for(std::chrono::microseconds(frame_us - t_spend.count()));
-        }
+    if (frame_acquired)
+    {
+        m_DeskDupl->ReleaseFrame();
     }
 }
 
-void Duplicator::start_duplicate()
+void Duplicator::start_capture()
 {
     m_capture_thread = std::move(std::thread([=]() {
         m_capture_running = true;
@@ -327,7 +373,7 @@ void Duplicator::start_duplicate()
         }));
 }
 
-void Duplicator::stop_duplicate()
+void Duplicator::stop_capture()
 {
     if (m_capture_running)
     {
@@ -339,7 +385,69 @@ void Duplicator::stop_duplicate()
     }
 }
 
-int32_t Duplicator::get_frame_data(uint8_t* buffer)
+void Duplicator::update_regions(DXGI_OUTDUPL_FRAME_INFO* frame_info)
+{
+    HRESULT hr;
+    UINT required = 0;
+
+    // pointer position is only valid when the mouse was updated
+    if (frame_info->LastMouseUpdateTime.QuadPart != 0)
+    {
+        m_cursor_visible = frame_info->PointerPosition.Visible ? true : false;
+        m_cursor_position = frame_info->PointerPosition.Position;
+    }
+
+    if (frame_info->TotalMetadataBufferSize == 0)
+    {
+        return;
+    }
+
+    if (frame_info->TotalMetadataBufferSize > m_metadata_size)
+    {
+        if (m_metadata_buffer) delete[] m_metadata_buffer;
+        m_metadata_size = frame_info->TotalMetadataBufferSize;
+        m_metadata_buffer = new uint8_t[m_metadata_size];
+    }
+
+    // destination of moved rects changed as well
+    hr = m_DeskDupl->GetFrameMoveRects(m_metadata_size, reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(m_metadata_buffer), &required);
+    if (FAILED(hr))
+    {
+        TRACE(_T("Failed to get frame move rects hr: 0x%x\n"), (unsigned int)hr);
+        m_region_count = -1;
+        return;
+    }
+
+    DXGI_OUTDUPL_MOVE_RECT* move_rects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(m_metadata_buffer);
+    for (UINT i = 0; i < required / sizeof(DXGI_OUTDUPL_MOVE_RECT); i++)
+    {
+        add_region(move_rects[i].DestinationRect);
+    }
+
+    hr = m_DeskDupl->GetFrameDirtyRects(m_metadata_size, reinterpret_cast<RECT*>(m_metadata_buffer), &required);
+    if (FAILED(hr))
+    {
+        TRACE(_T("Failed to get frame dirty rects hr: 0x%x\n"), (unsigned int)hr);
+        m_region_count = -1;
+        return;
+    }
+
+    RECT* dirty_rects = reinterpret_cast<RECT*>(m_metadata_buffer);
+    for (UINT i = 0; i < required / sizeof(RECT); i++)
+    {
+        add_region(dirty_rects[i]);
+    }
+}
+
+void Duplicator::add_region(const RECT& rect)
+{
+    FrameRegion region = { rect.left, rect.top, rect.right, rect.bottom };
+
+    // unknown stays unknown until the next get_frame_data
+    add_frame_region(m_regions, &m_region_count, region);
+}
+
+int32_t Duplicator::get_frame_data(uint8_t* buffer, FrameInfo* info)
 {
     if (!m_frame_buffer)
     {
@@ -348,6 +456,24 @@ int32_t Duplicator::get_frame_data(uint8_t* buffer)
 
     m_mutex.lock();
     CopyMemory(buffer, m_frame_buffer, m_frame_buffer_len);
+
+    if (info)
+    {
+        info->region_count = m_region_count;
+        for (int32_t i = 0; i < m_region_count; i++)
+        {
+            info->regions[i] = m_regions[i];
+        }
+
+        info->cursor_visible = m_cursor_visible;
+        info->cursor.left = max(0L, m_cursor_position.x - CURSOR_REGION_SIZE / 2);
+        info->cursor.top = max(0L, m_cursor_position.y - CURSOR_REGION_SIZE / 2);
+        info->cursor.right = min((LONG)m_width, m_cursor_position.x + CURSOR_REGION_SIZE / 2);
+        info->cursor.bottom = min((LONG)m_height, m_cursor_position.y + CURSOR_REGION_SIZE / 2);
+    }
+
+    // following frames only report what changed after this copy
+    m_region_count = 0;
     m_mutex.unlock();
 
     return 0;
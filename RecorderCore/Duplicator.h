@@ -0,0 +1,66 @@
+#pragma once
+
+#include <mutex>
+
+#include "CaptureSource.h"
+
+// side length of the active area around the mouse pointer
+#define CURSOR_REGION_SIZE 256
+// longest AcquireNextFrame wait, a stop request is noticed within this time
+#define DUPLICATOR_ACQUIRE_TIMEOUT_MS 100
+
+// DXGI Desktop Duplication of one display, Windows only
+class Duplicator : public CaptureSource
+{
+public:
+    Duplicator();
+	~Duplicator();
+
+    HRESULT initialize(const wchar_t* target_display, int32_t fps);
+    int32_t get_width() override { return m_width; }
+    int32_t get_height() override { return m_height; }
+    int32_t get_bytepixel() override { return m_bytepixel; }
+    int32_t get_frame_buffer_length() override { return m_frame_buffer_len; }
+    int32_t get_frame_data(uint8_t *buffer, FrameInfo* info = nullptr) override;
+    int32_t get_frame_data_yuv420(uint8_t* buffer);
+
+    void desktop_duplication_thread();
+    void start_capture() override;
+    void stop_capture() override;
+
+protected:
+    int get_bytepixel(DXGI_FORMAT format);
+    char* get_duplicate_rotation(DXGI_MODE_ROTATION rotation);
+    char* get_duplicate_format(DXGI_FORMAT format);
+    void update_regions(DXGI_OUTDUPL_FRAME_INFO* frame_info);
+    void add_region(const RECT& rect);
+
+private:
+    int32_t m_width;
+    int32_t m_height;
+    int32_t m_bytepixel;
+    int32_t m_frame_buffer_len;
+    uint8_t* m_frame_buffer;
+
+    ID3D11Device* m_Device;
+    ID3D11DeviceContext* m_Context;
+    IDXGIOutputDuplication* m_DeskDupl;
+    ID3D11Texture2D* m_AcquiredDesktopImage;
+    ID3D11Texture2D* m_StagingTexture;
+    DXGI_OUTPUT_DESC m_DesktopDesc;
+    DXGI_OUTDUPL_DESC m_DuplicationDesc;
+
+    // changed regions and pointer accumulated since the last get_frame_data
+    uint8_t* m_metadata_buffer;
+    UINT m_metadata_size;
+    int32_t m_region_count;
+    FrameRegion m_regions[MAX_FRAME_REGIONS];
+    bool m_cursor_visible;
+    POINT m_cursor_position;
+
+    int32_t m_fps;
+    bool m_capture_running;
+    std::mutex m_mutex;
+    std::thread m_capture_thread;
+};
+
@@ -0,0 +1,1138 @@
+#include "pch.h"
+#include "Encoder.h"
+
+#ifdef _MSC_VER
+#pragma comment(lib, "avdevice.lib")
+#pragma comment(lib, "avformat.lib")
+#pragma comment(lib, "avfilter.lib")
+#pragma comment(lib, "avcodec.lib")
+#pragma comment(lib, "swresample.lib")
+#pragma comment(lib, "swscale.lib")
+#pragma comment(lib, "avutil.lib")
+
+#pragma warning(disable : 4996)
+#pragma warning(disable : 26812)
+#endif
+
+//#define ENABLE_OUTPUT_THREAD
+
+// region of interest quantizer offsets, libx264 scales these by 25 QP
+#define ROI_ACTIVE_QOFFSET { -1, 5 }
+#define ROI_STATIC_QOFFSET { 1, 10 }
+#define ROI_NEUTRAL_QOFFSET { 0, 1 }
+// changed regions, cursor area and the whole frame as static background
+#define ROI_ENTRIES (MAX_FRAME_REGIONS + 2)
+
+struct EncoderModeOptions
+{
+	const char* name;
+	const char* preset;
+	const char* tune;			// nullptr for no tune
+	int32_t gop_seconds;
+	int32_t max_b_frames;
+	int32_t thread_type;
+	int32_t rc_lookahead;
+	const char* x264_params;
+};
+
+// indexed by EncoderMode
+static const EncoderModeOptions encoder_mode_options[] =
+{
+	{ "low-latency", "faster", "zerolatency", 1, 0, FF_THREAD_SLICE, 0, "sliced-threads=1:sync-lookahead=0" },
+	{ "throughput", "faster", nullptr, 2, 3, FF_THREAD_FRAME, 40, "sliced-threads=0" },
+	{ "archival", "slow", nullptr, 10, 3, FF_THREAD_FRAME, 60, "sliced-threads=0" },
+};
+
+Encoder::Encoder() :
+	m_output(nullptr),
+	m_replay(nullptr),
+	m_live(nullptr),
+	m_playlist(nullptr),
+	m_codec_context(nullptr),
+	m_swsctx(nullptr),
+	m_frame(nullptr),
+	m_frame_pool(nullptr),
+	m_roi_side_data(nullptr),
+	m_packet(nullptr),
+	m_width(0),
+	m_height(0),
+	m_output_width(0),
+	m_output_height(0),
+	m_bytepixel(0),
+	m_fps(0),
+	m_bitrate(0),
+	m_frame_length(0),
+	m_mode(ENCODER_MODE_LOW_LATENCY),
+	m_rate_control(RATE_CONTROL_ABR),
+	m_crf(23),
+	m_max_bitrate(0),
+	m_buffer_size(0),
+	m_roi(true),
+	m_keyframe_policy(KEYFRAME_POLICY_FIXED_GOP),
+	m_keyframe_interval(0),
+	m_write_buffer_size(DEFAULT_WRITE_BUFFER_SIZE),
+	m_write_buffer_count(DEFAULT_WRITE_BUFFER_COUNT),
+	m_preallocate(0),
+	m_write_rate(0),
+	m_segment_seconds(0),
+	m_segment_bytes(0),
+	m_replay_seconds(0),
+	m_replay_max_bytes(0),
+	m_stats(nullptr),
+	m_encode_us(0),
+	m_submitted_frames(0),
+	m_encoded_packets(0),
+	m_encoded_bytes(0),
+	m_first_pts(AV_NOPTS_VALUE),
+	m_last_pts(AV_NOPTS_VALUE),
+	m_window_start(AV_NOPTS_VALUE),
+	m_window_bytes(0),
+	m_min_window_bitrate(0),
+	m_max_window_bitrate(0),
+	m_playlist_keyframe_frames(0),
+	m_next_playlist_keyframe(0),
+	m_keyframe_requested(false),
+	m_segment_start_pts(AV_NOPTS_VALUE),
+	m_segment_start_bytes(0),
+	m_segment_count(0),
+	m_segment_rollover(false),
+	m_flush_us(0),
+	m_flush_truncated(false),
+	m_output_running(false)
+{
+	memset(m_capture_times, 0, sizeof(m_capture_times));
+	memset(m_present_times, 0xFF, sizeof(m_present_times));
+}
+
+Encoder::~Encoder()
+{
+	wait_segment_closed();
+
+	if (m_swsctx)
+	{
+		sws_freeContext(m_swsctx);
+		m_swsctx = nullptr;
+	}
+
+	if (m_frame)
+	{
+		av_frame_free(&m_frame);
+		m_frame = nullptr;
+	}
+
+	if (m_packet)
+	{
+		av_packet_free(&m_packet);
+		m_packet = nullptr;
+	}
+
+	// pools are released once the encoder returned every buffer
+	if (m_frame_pool) av_buffer_pool_uninit(&m_frame_pool);
+
+	if (m_codec_context)
+	{
+		avcodec_close(m_codec_context);
+		avcodec_free_context(&m_codec_context);
+		m_codec_context = nullptr;
+	}
+
+	if (m_output)
+	{
+		delete m_output;
+		m_output = nullptr;
+	}
+
+	if (m_replay)
+	{
+		delete m_replay;
+		m_replay = nullptr;
+	}
+
+	if (m_live)
+	{
+		delete m_live;
+		m_live = nullptr;
+	}
+
+	if (m_playlist)
+	{
+		delete m_playlist;
+		m_playlist = nullptr;
+	}
+}
+
+int32_t Encoder::initialize()
+{
+	int32_t ret = 0;
+	AVCodec* codec = NULL;
+
+	m_frame_length = m_width * m_height * m_bytepixel;
+	if (m_frame_length == 0)
+	{
+		TRACE(_T("display size invalid\n"));
+		return -1;
+	}
+
+	if (m_fps == 0)
+	{
+		TRACE(_T("fps invalid\n"));
+		return -1;
+	}
+
+	// yuv420p needs even dimensions
+	if (m_output_width == 0 || m_output_height == 0)
+	{
+		m_output_width = m_width;
+		m_output_height = m_height;
+	}
+	m_output_width &= ~1;
+	m_output_height &= ~1;
+
+	if (m_bitrate == 0 && (m_rate_control == RATE_CONTROL_ABR || m_rate_control == RATE_CONTROL_CBR))
+	{
+		TRACE(_T("bitrate invalid\n"));
+		return -1;
+	}
+
+	if (m_max_bitrate == 0 && m_rate_control == RATE_CONTROL_CAPPED_CRF)
+	{
+		TRACE(_T("max bitrate invalid\n"));
+		return -1;
+	}
+
+	//codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+	codec = avcodec_find_encoder_by_name("libx264");
+	if (!codec)
+	{
+		TRACE(_T("cannot found codec\n"));
+		return -1;
+	}
+
+	m_codec_context = avcodec_alloc_context3(codec);
+	if (!m_codec_context)
+	{
+		TRACE(_T("Cannot allocate codec context\n"));
+		return -1;
+	}
+
+	// SPS/PPS stay in band so every container, including the ones opened later, can use the stream
+	m_codec_context->width = m_output_width;
+	m_codec_context->height = m_output_height;
+	m_codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+	m_codec_context->time_base = { 1, m_fps };
+	m_codec_context->framerate = { m_fps, 1 };
+
+	apply_mode(codec);
+	apply_rate_control();
+	apply_keyframe_policy();
+
+	// forced keyframes are IDR so markers are instant seek points
+	av_opt_set_int(m_codec_context->priv_data, "forced-idr", 1, 0);
+
+	ret = avcodec_open2(m_codec_context, codec, nullptr);
+	if (ret < 0)
+	{
+		TRACE(_T("cannot open codec %d\n"), ret);
+		return -1;
+	}
+
+	if (m_replay_seconds > 0)
+	{
+		m_replay = new ReplayBuffer();
+		if (m_replay->initialize(m_codec_context, m_replay_max_bytes, (int64_t)m_replay_seconds * m_fps) < 0)
+		{
+			return -1;
+		}
+	}
+
+	m_frame = av_frame_alloc();
+	if (!m_frame)
+	{
+		TRACE(_T("cannot allocate video frame\n"));
+		return -1;
+	}
+
+	// refcounted pictures from a pool, libavcodec keeps a reference instead of copying each frame
+	ret = av_image_get_buffer_size(m_codec_context->pix_fmt, m_codec_context->width, m_codec_context->height, 32);
+	if (ret < 0)
+	{
+		TRACE(_T("cannot get raw picture size\n"));
+		return -1;
+	}
+
+	m_frame_pool = av_buffer_pool_init(ret, nullptr);
+	if (!m_frame_pool)
+	{
+		TRACE(_T("cannot allocate raw picture pool\n"));
+		return -1;
+	}
+
+	m_packet = av_packet_alloc();
+	if (!m_packet)
+	{
+		TRACE(_T("cannot allocate packet\n"));
+		return -1;
+	}
+
+	m_swsctx = nullptr;
+	m_swsctx = sws_getContext(m_width, m_height, AV_PIX_FMT_BGRA,
+		m_codec_context->width, m_codec_context->height, AV_PIX_FMT_YUV420P,
+		(m_output_width != m_width || m_output_height != m_height) ? SWS_BILINEAR : 0, 0, 0, 0);
+	if (m_swsctx == nullptr)
+	{
+		TRACE(_T("sws_getContext error\n"));
+		return -1;
+	}
+
+	return 0;
+}
+
+void Encoder::apply_mode(const AVCodec* codec)
+{
+	const EncoderModeOptions& options = encoder_mode_options[m_mode];
+
+	m_codec_context->gop_size = options.gop_seconds * m_fps;
+	m_codec_context->max_b_frames = options.max_b_frames;
+	m_codec_context->thread_type = options.thread_type;
+	m_codec_context->thread_count = 0;	// one thread per core
+
+	if (codec->id == AV_CODEC_ID_H264)
+	{
+		// https://trac.ffmpeg.org/wiki/Encode/H.264
+		// available presets
+		// ultrafast, superfast, veryfast, faster, fast, medium, slow, slower, veryslow
+		av_opt_set(m_codec_context->priv_data, "preset", options.preset, 0);
+		// available tune
+		// film, animation, grain, stillimage, fastdecode, zerolatency, psnr, ssim
+		if (options.tune)
+		{
+			av_opt_set(m_codec_context->priv_data, "tune", options.tune, 0);
+		}
+		//av_opt_set(m_codec_context->priv_data, "profile", "high", 0);
+		av_opt_set_int(m_codec_context->priv_data, "rc-lookahead", options.rc_lookahead, 0);
+		av_opt_set(m_codec_context->priv_data, "x264-params", options.x264_params, 0);
+	}
+
+	TRACE(_T("encoder mode %s\n"), options.name);
+}
+
+void Encoder::apply_rate_control()
+{
+	switch (m_rate_control)
+	{
+	case RATE_CONTROL_ABR:
+		m_codec_context->bit_rate = m_bitrate;
+		break;
+
+	case RATE_CONTROL_CRF:
+		m_codec_context->bit_rate = 0;
+		av_opt_set_double(m_codec_context->priv_data, "crf", m_crf, 0);
+		break;
+
+	case RATE_CONTROL_CAPPED_CRF:
+		// default VBV buffer holds one second at max bitrate
+		m_codec_context->bit_rate = 0;
+		m_codec_context->rc_max_rate = m_max_bitrate;
+		m_codec_context->rc_buffer_size = m_buffer_size ? m_buffer_size : m_max_bitrate;
+		av_opt_set_double(m_codec_context->priv_data, "crf", m_crf, 0);
+		break;
+
+	case RATE_CONTROL_CBR:
+		m_codec_context->bit_rate = m_bitrate;
+		m_codec_context->rc_min_rate = m_bitrate;
+		m_codec_context->rc_max_rate = m_bitrate;
+		m_codec_context->rc_buffer_size = m_buffer_size ? m_buffer_size : m_bitrate;
+		av_opt_set(m_codec_context->priv_data, "nal-hrd", "cbr", 0);
+		break;
+	}
+
+	TRACE(_T("rate control %s, bitrate %d, crf %d, max bitrate %d, buffer size %d\n"),
+		get_rate_control_name(m_rate_control), (int32_t)m_codec_context->bit_rate, m_crf,
+		(int32_t)m_codec_context->rc_max_rate, m_codec_context->rc_buffer_size);
+}
+
+void Encoder::apply_keyframe_policy()
+{
+	switch (m_keyframe_policy)
+	{
+	case KEYFRAME_POLICY_FIXED_GOP:
+		// interval of the encoder mode unless given
+		if (m_keyframe_interval > 0) m_codec_context->gop_size = m_keyframe_interval;
+		break;
+
+	case KEYFRAME_POLICY_INTRA_REFRESH:
+		// keyint is the refresh period, default refresh once per second
+		m_codec_context->gop_size = m_keyframe_interval > 0 ? m_keyframe_interval : m_fps;
+		av_opt_set_int(m_codec_context->priv_data, "intra-refresh", 1, 0);
+		break;
+
+	case KEYFRAME_POLICY_LONG_GOP:
+		// default one IDR per minute
+		m_codec_context->gop_size = m_keyframe_interval > 0 ? m_keyframe_interval : m_fps * 60;
+		break;
+	}
+
+	TRACE(_T("keyframe policy %s, interval %d\n"), get_keyframe_policy_name(m_keyframe_policy), m_codec_context->gop_size);
+}
+
+const char* Encoder::get_keyframe_policy_name(KeyframePolicy policy)
+{
+	switch (policy)
+	{
+	case KEYFRAME_POLICY_FIXED_GOP:
+		return "fixed-gop";
+	case KEYFRAME_POLICY_INTRA_REFRESH:
+		return "intra-refresh";
+	case KEYFRAME_POLICY_LONG_GOP:
+		return "long-gop";
+	}
+
+	return "unknown keyframe policy";
+}
+
+bool Encoder::parse_keyframe_policy_name(const char* name, KeyframePolicy* policy)
+{
+	for (int32_t i = KEYFRAME_POLICY_FIXED_GOP; i <= KEYFRAME_POLICY_LONG_GOP; i++)
+	{
+		if (strcmp(name, get_keyframe_policy_name((KeyframePolicy)i)) == 0)
+		{
+			*policy = (KeyframePolicy)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* Encoder::get_rate_control_name(RateControl rate_control)
+{
+	switch (rate_control)
+	{
+	case RATE_CONTROL_ABR:
+		return "abr";
+	case RATE_CONTROL_CRF:
+		return "crf";
+	case RATE_CONTROL_CAPPED_CRF:
+		return "capped-crf";
+	case RATE_CONTROL_CBR:
+		return "cbr";
+	}
+
+	return "unknown rate control";
+}
+
+bool Encoder::parse_rate_control_name(const char* name, RateControl* rate_control)
+{
+	for (int32_t i = RATE_CONTROL_ABR; i <= RATE_CONTROL_CBR; i++)
+	{
+		if (strcmp(name, get_rate_control_name((RateControl)i)) == 0)
+		{
+			*rate_control = (RateControl)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* Encoder::get_mode_name(EncoderMode mode)
+{
+	return encoder_mode_options[mode].name;
+}
+
+bool Encoder::parse_mode_name(const char* name, EncoderMode* mode)
+{
+	for (int32_t i = ENCODER_MODE_LOW_LATENCY; i <= ENCODER_MODE_ARCHIVAL; i++)
+	{
+		if (strcmp(name, get_mode_name((EncoderMode)i)) == 0)
+		{
+			*mode = (EncoderMode)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int64_t Encoder::get_average_bitrate()
+{
+	if (m_encoded_packets == 0 || m_last_pts <= m_first_pts)
+	{
+		return 0;
+	}
+
+	// packet timestamps are in codec time base, 1 / fps
+	return m_encoded_bytes * 8 * m_fps / (m_last_pts - m_first_pts);
+}
+
+int32_t Encoder::get_pool_frame()
+{
+	// drops our reference to the previous picture, the pool gets it back once the encoder is done,
+	// only the picture buffer changes so side data and frame properties stay allocated
+	av_buffer_unref(&m_frame->buf[0]);
+
+	m_frame->format = m_codec_context->pix_fmt;
+	m_frame->width = m_output_width;
+	m_frame->height = m_output_height;
+
+	m_frame->buf[0] = av_buffer_pool_get(m_frame_pool);
+	if (!m_frame->buf[0])
+	{
+		TRACE(_T("cannot get raw picture buffer\n"));
+		return -1;
+	}
+
+	av_image_fill_arrays(m_frame->data, m_frame->linesize, m_frame->buf[0]->data,
+		m_codec_context->pix_fmt, m_output_width, m_output_height, 32);
+
+	return 0;
+}
+
+int32_t Encoder::encode_frame(uint8_t* buffer, const FrameInfo& info)
+{
+	if (get_pool_frame() < 0)
+	{
+		return -1;
+	}
+
+	uint8_t* inData[1] = { buffer };
+	int in_linesize[1] = { m_bytepixel * m_width };
+	/*
+	m_swsctx = sws_getCachedContext(m_swsctx, 
+		m_frame->width, m_frame->height, AV_PIX_FMT_BGRA,
+		m_frame->width, m_frame->height, AV_PIX_FMT_YUV420P,
+		0, 0, 0, 0);
+	*/
+	std::chrono::steady_clock::time_point t_convert = std::chrono::steady_clock::now();
+	sws_scale(m_swsctx, inData, in_linesize, 0, m_height, m_frame->data, m_frame->linesize);
+	if (m_stats) m_stats->add_stage(PIPELINE_STAGE_CONVERT, t_convert, info.pts);
+
+	m_frame->pts = info.pts;
+	m_capture_times[info.pts % CAPTURE_TIME_SLOTS] = info.capture_us;
+	m_present_times[info.pts % CAPTURE_TIME_SLOTS] = info.present_us;
+	if (m_playlist_keyframe_frames > 0 && info.pts >= m_next_playlist_keyframe)
+	{
+		m_keyframe_requested = true;
+		m_next_playlist_keyframe = info.pts + m_playlist_keyframe_frames;
+	}
+	attach_regions(&info);
+	apply_keyframe_request();
+
+	return submit_frame();
+}
+
+int32_t Encoder::encode_duplicate(int64_t pts)
+{
+	// m_frame still holds the last converted picture, resend it with a new timestamp
+	m_capture_times[pts % CAPTURE_TIME_SLOTS] = m_capture_times[m_frame->pts % CAPTURE_TIME_SLOTS];
+	m_present_times[pts % CAPTURE_TIME_SLOTS] = -1;
+	m_frame->pts = pts;
+	attach_regions(nullptr);
+	apply_keyframe_request();
+
+	return submit_frame();
+}
+
+int32_t Encoder::submit_frame()
+{
+	int ret = 0;
+	std::chrono::steady_clock::time_point t_encode = std::chrono::steady_clock::now();
+	// on the timeline the packets muxed from this submit nest inside it
+	TraceScope trace("encode", m_frame->pts);
+
+	ret = avcodec_send_frame(m_codec_context, m_frame);
+	if (ret < 0)
+	{
+		TRACE(_T("avcodec_send_frame error %d\n"), ret);
+		return -1;
+	}
+	m_submitted_frames++;
+
+	// receive_packets adds its own encoder time, the muxing in between is timed separately
+	m_encode_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_encode).count();
+	ret = receive_packets();
+	if (m_stats) m_stats->add_stage_us(PIPELINE_STAGE_ENCODE, m_encode_us);
+
+	return ret;
+}
+
+void Encoder::request_keyframe()
+{
+	m_keyframe_requested = true;
+}
+
+void Encoder::add_marker(const char* title)
+{
+	std::lock_guard<std::mutex> lock(m_marker_mutex);
+
+	// timestamp is assigned when the forced keyframe is sent
+	m_markers.push_back({ AV_NOPTS_VALUE, title ? title : "" });
+	m_keyframe_requested = true;
+}
+
+void Encoder::apply_keyframe_request()
+{
+	if (!m_keyframe_requested.exchange(false))
+	{
+		m_frame->pict_type = AV_PICTURE_TYPE_NONE;
+		return;
+	}
+
+	m_frame->pict_type = AV_PICTURE_TYPE_I;
+
+	std::lock_guard<std::mutex> lock(m_marker_mutex);
+	for (auto& marker : m_markers)
+	{
+		if (marker.pts == AV_NOPTS_VALUE) marker.pts = m_frame->pts;
+	}
+}
+
+int32_t Encoder::write_chapters(Muxer* output, int64_t start_pts, int64_t end_pts)
+{
+	std::lock_guard<std::mutex> lock(m_marker_mutex);
+
+	if (!output)
+	{
+		return 0;
+	}
+
+	// each marker becomes a chapter lasting until the next one or the end of the file
+	for (size_t i = 0; i < m_markers.size(); i++)
+	{
+		if (m_markers[i].pts == AV_NOPTS_VALUE) continue;
+		if (m_markers[i].pts < start_pts || m_markers[i].pts >= end_pts) continue;
+
+		int64_t end = (i + 1 < m_markers.size() && m_markers[i + 1].pts != AV_NOPTS_VALUE) ? m_markers[i + 1].pts : end_pts;
+		if (end > end_pts) end = end_pts;
+		if (output->add_chapter((int32_t)i, m_markers[i].pts, end, m_markers[i].title.c_str()) < 0)
+		{
+			return -1;
+		}
+
+		TRACE(_T("marker %d at pts %lld : %s\n"), (int)i, (long long)m_markers[i].pts, m_markers[i].title.c_str());
+	}
+
+	return 0;
+}
+
+int32_t Encoder::attach_regions(const FrameInfo* info)
+{
+	int32_t count = 0;
+	AVRegionOfInterest* roi = nullptr;
+
+	if (!m_roi)
+	{
+		return 0;
+	}
+
+	// added once and rewritten for every frame, the frame keeps its side data across pictures
+	if (!m_roi_side_data)
+	{
+		m_roi_side_data = av_frame_new_side_data(m_frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, ROI_ENTRIES * sizeof(AVRegionOfInterest));
+		if (!m_roi_side_data)
+		{
+			TRACE(_T("cannot allocate region of interest side data\n"));
+			return -1;
+		}
+	}
+
+	// earlier entries take precedence where regions overlap, regions are scaled from capture to encoded size
+	roi = reinterpret_cast<AVRegionOfInterest*>(m_roi_side_data->data);
+	count = 0;
+	if (info && info->region_count < 0)
+	{
+		// without change information every part of the frame is treated the same
+		roi[count].self_size = sizeof(AVRegionOfInterest);
+		roi[count].left = 0;
+		roi[count].top = 0;
+		roi[count].right = m_output_width;
+		roi[count].bottom = m_output_height;
+		roi[count].qoffset = ROI_NEUTRAL_QOFFSET;
+		count++;
+	}
+	else
+	{
+		if (info)
+		{
+			for (int32_t i = 0; i < info->region_count; i++)
+			{
+				roi[count].self_size = sizeof(AVRegionOfInterest);
+				roi[count].left = info->regions[i].left * m_output_width / m_width;
+				roi[count].top = info->regions[i].top * m_output_height / m_height;
+				roi[count].right = info->regions[i].right * m_output_width / m_width;
+				roi[count].bottom = info->regions[i].bottom * m_output_height / m_height;
+				roi[count].qoffset = ROI_ACTIVE_QOFFSET;
+				count++;
+			}
+
+			if (info->cursor_visible)
+			{
+				roi[count].self_size = sizeof(AVRegionOfInterest);
+				roi[count].left = info->cursor.left * m_output_width / m_width;
+				roi[count].top = info->cursor.top * m_output_height / m_height;
+				roi[count].right = info->cursor.right * m_output_width / m_width;
+				roi[count].bottom = info->cursor.bottom * m_output_height / m_height;
+				roi[count].qoffset = ROI_ACTIVE_QOFFSET;
+				count++;
+			}
+		}
+
+		roi[count].self_size = sizeof(AVRegionOfInterest);
+		roi[count].left = 0;
+		roi[count].top = 0;
+		roi[count].right = m_output_width;
+		roi[count].bottom = m_output_height;
+		roi[count].qoffset = ROI_STATIC_QOFFSET;
+		count++;
+	}
+
+	// every entry is passed on, newer libavcodec rebuilds the side data from the whole buffer when it
+	// references the frame, so the unused tail is kept as empty regions that cover no macroblock
+	for (; count < ROI_ENTRIES; count++)
+	{
+		roi[count].self_size = sizeof(AVRegionOfInterest);
+		roi[count].left = 0;
+		roi[count].top = 0;
+		roi[count].right = 0;
+		roi[count].bottom = 0;
+		roi[count].qoffset = ROI_NEUTRAL_QOFFSET;
+	}
+
+	return 0;
+}
+
+int32_t Encoder::receive_packets()
+{
+	int ret = 0;
+#ifndef ENABLE_OUTPUT_THREAD
+	while (ret >= 0)
+	{
+		std::chrono::steady_clock::time_point t_receive = std::chrono::steady_clock::now();
+		ret = avcodec_receive_packet(m_codec_context, m_packet);
+		m_encode_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_receive).count();
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+		{
+			break;
+		}
+		else if (ret < 0)
+		{
+			TRACE(_T("error during encoding %d\n"), ret);
+			break;
+		}
+
+		// save frame to file - data : m_pkt->data, size : m_pkt->size
+		write_packet(m_packet);
+
+		av_packet_unref(m_packet);
+	}
+#endif
+	return ret;
+}
+
+void Encoder::write_packet(AVPacket* pkt)
+{
+	m_encoded_packets++;
+	m_encoded_bytes += pkt->size;
+	if (m_stats)
+	{
+		m_stats->add_encoded_frame(pkt->size, (pkt->flags & AV_PKT_FLAG_KEY) != 0);
+		// only packets of a new picture tell how long a change on screen takes to be encoded
+		int64_t present_us = m_present_times[pkt->pts % CAPTURE_TIME_SLOTS];
+		if (present_us >= 0)
+		{
+			m_stats->add_glass_to_packet_us(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - m_clock_origin).count() - present_us);
+		}
+	}
+	if (m_first_pts == AV_NOPTS_VALUE || pkt->pts < m_first_pts) m_first_pts = pkt->pts;
+	if (m_last_pts == AV_NOPTS_VALUE || pkt->pts + 1 > m_last_pts) m_last_pts = pkt->pts + 1;
+	update_bitrate_window(pkt);
+
+	if (m_replay) m_replay->push(pkt);
+	if (m_packet_callback) m_packet_callback(pkt, m_capture_times[pkt->pts % CAPTURE_TIME_SLOTS]);
+	if (m_live || m_playlist)
+	{
+		std::chrono::steady_clock::time_point capture_time = m_clock_origin + std::chrono::microseconds(m_capture_times[pkt->pts % CAPTURE_TIME_SLOTS]);
+		if (m_live) m_live->push(pkt, capture_time);
+		if (m_playlist) m_playlist->push(pkt, capture_time);
+	}
+
+	if (m_output && (m_segment_seconds > 0 || m_segment_bytes > 0))
+	{
+		if (m_segment_start_pts == AV_NOPTS_VALUE) m_segment_start_pts = pkt->pts;
+
+		// once a limit is reached the next frame is forced to IDR, the new segment starts on its packet
+		if (!m_segment_rollover &&
+			((m_segment_seconds > 0 && pkt->pts - m_segment_start_pts >= (int64_t)m_segment_seconds * m_fps) ||
+			(m_segment_bytes > 0 && m_encoded_bytes - m_segment_start_bytes >= m_segment_bytes)))
+		{
+			m_segment_rollover = true;
+			m_keyframe_requested = true;
+		}
+
+		if (m_segment_rollover && (pkt->flags & AV_PKT_FLAG_KEY))
+		{
+			roll_segment(pkt->pts);
+			m_segment_start_bytes = m_encoded_bytes - pkt->size;
+		}
+	}
+
+	if (m_output) m_output->write_packet(pkt);
+}
+
+void Encoder::roll_segment(int64_t pts)
+{
+	Muxer* previous = m_output;
+	int64_t start_pts = m_segment_start_pts;
+
+	m_segment_rollover = false;
+
+	// the encoder keeps running, only the container changes
+	m_output = nullptr;
+	if (open_muxer(m_output_filename.c_str(), pts) < 0)
+	{
+		TRACE(_T("cannot open next segment, continuing in the current one\n"));
+		m_output = previous;
+		return;
+	}
+
+	write_chapters(previous, start_pts, pts);
+
+	m_segment_start_pts = pts;
+
+	// trailer and buffered writes of the finished segment do not hold up encoding
+	wait_segment_closed();
+	m_segment_thread = std::move(std::thread([=]() {
+		previous->close();
+		delete previous;
+		}));
+}
+
+void Encoder::wait_segment_closed()
+{
+	if (m_segment_thread.joinable())
+	{
+		m_segment_thread.join();
+	}
+}
+
+void Encoder::update_bitrate_window(AVPacket* pkt)
+{
+	int64_t window_bitrate = 0;
+
+	// dts is monotonic even with B-frames
+	if (m_window_start == AV_NOPTS_VALUE)
+	{
+		m_window_start = pkt->dts;
+	}
+
+	if (pkt->dts - m_window_start >= m_fps)
+	{
+		window_bitrate = m_window_bytes * 8;
+		if (m_min_window_bitrate == 0 || window_bitrate < m_min_window_bitrate) m_min_window_bitrate = window_bitrate;
+		if (window_bitrate > m_max_window_bitrate) m_max_window_bitrate = window_bitrate;
+
+		m_window_start = pkt->dts;
+		m_window_bytes = 0;
+	}
+
+	m_window_bytes += pkt->size;
+}
+
+int32_t Encoder::save_replay(const char* filename, ReplaySaveCallback callback)
+{
+	if (!m_replay)
+	{
+		TRACE(_T("replay is not enabled\n"));
+		return -1;
+	}
+
+	return m_replay->save(filename, callback);
+}
+
+int32_t Encoder::live_open(const char* url, int32_t mux_delay_ms, int64_t pace_bitrate)
+{
+	m_live = new LiveOutput();
+	if (m_live->open(url, m_codec_context, mux_delay_ms, pace_bitrate) < 0)
+	{
+		delete m_live;
+		m_live = nullptr;
+		return -1;
+	}
+
+	return 0;
+}
+
+int32_t Encoder::playlist_open(const char* playlist, int32_t segment_seconds, int32_t list_size)
+{
+	char value[32] = { 0, };
+	std::string name = playlist;
+	bool dash = name.size() >= 4 && name.compare(name.size() - 4, 4, ".mpd") == 0;
+	int64_t segment_frames = 0;
+
+	if (segment_seconds <= 0)
+	{
+		TRACE(_T("playlist segment duration invalid\n"));
+		return -1;
+	}
+
+	// segments are cut on keyframes, force one per segment unless the GOP already divides it
+	segment_frames = (int64_t)segment_seconds * m_fps;
+	if (m_keyframe_policy != KEYFRAME_POLICY_FIXED_GOP || segment_frames % m_codec_context->gop_size != 0)
+	{
+		m_playlist_keyframe_frames = (int32_t)segment_frames;
+		m_next_playlist_keyframe = 0;
+	}
+
+	// segments are files fetched later, none of them may lose a packet to a slow disk
+	m_playlist = new LiveOutput();
+	m_playlist->set_lossless(true);
+	snprintf(value, sizeof(value), "%d", segment_seconds);
+	if (dash)
+	{
+		m_playlist->set_format("dash");
+		m_playlist->set_format_option("seg_duration", value);
+		m_playlist->set_format_option("use_template", "1");
+		m_playlist->set_format_option("use_timeline", "1");
+		snprintf(value, sizeof(value), "%d", list_size);
+		m_playlist->set_format_option("window_size", value);
+	}
+	else
+	{
+		// playlist is written to a temporary file and renamed, readers never see it half written
+		m_playlist->set_format("hls");
+		m_playlist->set_format_option("hls_segment_type", "fmp4");
+		m_playlist->set_format_option("hls_time", value);
+		snprintf(value, sizeof(value), "%d", list_size);
+		m_playlist->set_format_option("hls_list_size", value);
+		if (list_size > 0)
+		{
+			m_playlist->set_format_option("hls_flags", "temp_file+independent_segments+delete_segments");
+		}
+		else
+		{
+			m_playlist->set_format_option("hls_flags", "temp_file+independent_segments");
+			m_playlist->set_format_option("hls_playlist_type", "event");
+		}
+	}
+
+	if (m_playlist->open(playlist, m_codec_context, 0, 0) < 0)
+	{
+		delete m_playlist;
+		m_playlist = nullptr;
+		m_playlist_keyframe_frames = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+void Encoder::output_thread()
+{
+	std::chrono::high_resolution_clock::time_point t_start, t_done;
+	std::chrono::microseconds t_spend;
+	int64_t frame_us = (1 * 1000 * 1000) / (m_fps * 2); // frames per seconds
+
+	int ret = 0;
+	t_start = std::chrono::high_resolution_clock::now();
+
+	while (m_output_running)
+	{
+		t_done = std::chrono::high_resolution_clock::now();
+		t_spend = std::chrono::duration_cast<std::chrono::microseconds>(t_done - t_start);
+		if (t_spend.count() < frame_us)
+			std::this_thread::sleep_for(std::chrono::microseconds(frame_us - t_spend.count()));
+		t_start = std::chrono::high_resolution_clock::now();
+
+		ret = avcodec_receive_packet(m_codec_context, m_packet);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+		{
+			continue;
+		}
+		else if (ret < 0)
+		{
+			TRACE(_T("avcodec_receive_packet error %d\n"), ret);
+			break;
+		}
+
+		write_packet(m_packet);
+		av_packet_unref(m_packet);
+	}
+}
+
+// name_YYYYMMDD-HHMMSS-mmm.ext, from the wall clock at the start of the segment
+static std::string segment_filename(const std::string& filename)
+{
+	std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+	time_t seconds = std::chrono::system_clock::to_time_t(now);
+	int32_t milliseconds = (int32_t)(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+	struct tm local = {};
+	char stamp[64] = { 0, };
+
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+	snprintf(stamp + strlen(stamp), sizeof(stamp) - strlen(stamp), "-%03d", milliseconds);
+
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return filename + "_" + stamp;
+	}
+
+	return filename.substr(0, dot) + "_" + stamp + filename.substr(dot);
+}
+
+int32_t Encoder::open_muxer(const char* filename, int64_t timestamp_offset)
+{
+	int ret = 0;
+	AVCodecParameters* codecpar = nullptr;
+	std::string name = filename;
+
+	if (m_segment_seconds > 0 || m_segment_bytes > 0)
+	{
+		name = segment_filename(name);
+	}
+
+	codecpar = avcodec_parameters_alloc();
+	if (!codecpar)
+	{
+		TRACE(_T("cannot allocate codec parameters\n"));
+		return -1;
+	}
+	avcodec_parameters_from_context(codecpar, m_codec_context);
+
+	m_output = new Muxer();
+	m_output->set_write_buffer(m_write_buffer_size, m_write_buffer_count);
+	m_output->set_preallocate(m_preallocate);
+	m_output->set_write_rate(m_write_rate);
+	m_output->set_timestamp_offset(timestamp_offset);
+	m_output->set_stats(m_stats);
+	ret = m_output->open(name.c_str(), codecpar, m_codec_context->time_base);
+	avcodec_parameters_free(&codecpar);
+	if (ret < 0)
+	{
+		delete m_output;
+		m_output = nullptr;
+		return -1;
+	}
+
+	m_segment_count++;
+
+	return 0;
+}
+
+int32_t Encoder::output_open(const char* filename)
+{
+	m_output_filename = filename;
+
+	if (open_muxer(filename, 0) < 0)
+	{
+		return -1;
+	}
+#ifdef ENABLE_OUTPUT_THREAD
+	m_output_thread = std::move(std::thread([=]() {
+		m_output_running = true;
+		output_thread();
+		}));
+#endif
+	return 0;
+}
+
+int32_t Encoder::output_close(std::chrono::steady_clock::time_point deadline)
+{
+	int ret = 0;
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+#ifdef ENABLE_OUTPUT_THREAD
+	if (m_output_running)
+	{
+		m_output_running = false;
+		if (m_output_thread.joinable())
+		{
+			m_output_thread.join();
+		}
+	}
+#endif
+	// enter draining mode once, then collect every delayed packet until the encoder reports EOF
+	ret = avcodec_send_frame(m_codec_context, nullptr);
+	if (ret < 0)
+	{
+		TRACE(_T("avcodec_send_frame flush error %d\n"), ret);
+	}
+
+	while (ret >= 0)
+	{
+		// past the deadline the remaining lookahead is dropped, the file still gets its trailer
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			TRACE(_T("flush deadline passed, truncating encoder output\n"));
+			m_flush_truncated = true;
+			break;
+		}
+
+		ret = avcodec_receive_packet(m_codec_context, m_packet);
+		if (ret == AVERROR_EOF)
+		{
+			break;
+		}
+		else if (ret < 0)
+		{
+			TRACE(_T("error during flush %d\n"), ret);
+			break;
+		}
+
+		write_packet(m_packet);
+		av_packet_unref(m_packet);
+	}
+
+	// every submitted frame yields exactly one packet once the encoder is fully drained
+	if (!m_flush_truncated && m_encoded_packets != m_submitted_frames)
+	{
+		TRACE(_T("encoded %lld packets for %lld submitted frames\n"), (long long)m_encoded_packets, (long long)m_submitted_frames);
+	}
+
+	// tail of the stream still goes out to a connected viewer
+	if (m_live)
+	{
+		m_live->close();
+	}
+
+	// final segment and the closing playlist
+	if (m_playlist)
+	{
+		m_playlist->close();
+	}
+
+	// previous segment must be complete before the recording counts as finalized
+	wait_segment_closed();
+
+	write_chapters(m_output, m_segment_start_pts == AV_NOPTS_VALUE ? INT64_MIN : m_segment_start_pts, m_last_pts);
+	if (m_output && m_output->close() < 0)
+	{
+		ret = -1;
+	}
+
+	m_flush_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+	TRACE(_T("flush %lld us%s\n"), (long long)m_flush_us, m_flush_truncated ? " (truncated)" : "");
+
+	TRACE(_T("%s %s : %lld packets, %lld bytes, bitrate avg %lld min %lld max %lld bps, %lld MB per hour\n"),
+		get_mode_name(m_mode), get_rate_control_name(m_rate_control), (long long)m_encoded_packets, (long long)m_encoded_bytes,
+		(long long)get_average_bitrate(), (long long)m_min_window_bitrate, (long long)m_max_window_bitrate,
+		(long long)(get_average_bitrate() * 3600 / 8 / (1000 * 1000)));
+	if (m_stats)
+	{
+		PipelineSnapshot snapshot;
+		m_stats->get_snapshot(&snapshot);
+		TRACE(_T("%s : %lld keyframes, packet size histogram\n"), get_keyframe_policy_name(m_keyframe_policy), (long long)snapshot.keyframe_packets);
+		for (int32_t i = 0; i < PACKET_SIZE_BUCKETS; i++)
+		{
+			if (snapshot.packet_size_histogram[i] == 0) continue;
+			TRACE(_T("\t%lld - %lld bytes : %lld\n"), 1LL << i, (1LL << (i + 1)) - 1, (long long)snapshot.packet_size_histogram[i]);
+		}
+	}
+
+	return ret < 0 && ret != AVERROR_EOF ? -1 : 0;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameInfo.h"
+#include "Muxer.h"
+#include "PipelineStats.h"
+#include "ReplayBuffer.h"
+#include "LiveOutput.h"
+
+// named x264 operating points, each maps to a full set of codec options
+enum EncoderMode
+{
+	ENCODER_MODE_LOW_LATENCY,	// sliced threads, no lookahead, no B-frames
+	ENCODER_MODE_THROUGHPUT,	// frame threads, rc lookahead, B-frames
+	ENCODER_MODE_ARCHIVAL,		// slow preset, long GOP
+};
+
+// rate control, bitrate values are in bits per second
+enum RateControl
+{
+	RATE_CONTROL_ABR,			// average bitrate only
+	RATE_CONTROL_CRF,			// constant quality, bitrate follows content
+	RATE_CONTROL_CAPPED_CRF,	// constant quality limited by max bitrate and VBV buffer
+	RATE_CONTROL_CBR,			// strict constant bitrate with VBV and HRD signalling
+};
+
+// how the stream gets its random access points
+enum KeyframePolicy
+{
+	KEYFRAME_POLICY_FIXED_GOP,		// IDR every keyframe interval
+	KEYFRAME_POLICY_INTRA_REFRESH,	// column-wise intra refresh spread over the keyframe interval, no periodic IDR
+	KEYFRAME_POLICY_LONG_GOP,		// rare periodic IDR, forced keyframes become IDR
+};
+
+// capture times kept for packets still inside the encoder, more than its deepest delay
+#define CAPTURE_TIME_SLOTS 256
+
+// every encoded packet in codec time base with the capture time of its frame, called on the encode thread
+typedef std::function<void(const AVPacket* pkt, int64_t capture_us)> PacketCallback;
+
+// operator mark written as a chapter, starts on a forced IDR
+struct EncoderMarker
+{
+	int64_t pts;
+	std::string title;
+};
+
+class Encoder
+{
+public:
+	Encoder();
+	~Encoder();
+
+	void set_width(uint32_t width) { m_width = width; }
+	void set_height(uint32_t height) { m_height = height; }
+	void set_bytepixel(uint32_t bytepixel) { m_bytepixel = bytepixel; }
+	// encoded size when it differs from the captured width and height, 0 to keep it
+	void set_output_size(uint32_t width, uint32_t height) { m_output_width = width; m_output_height = height; }
+	void set_fps(uint32_t fps) { m_fps = fps; }
+	void set_bitrate(uint32_t bitrate) { m_bitrate = bitrate; }
+	void set_mode(EncoderMode mode) { m_mode = mode; }
+	void set_rate_control(RateControl rate_control) { m_rate_control = rate_control; }
+	void set_crf(int32_t crf) { m_crf = crf; }
+	void set_max_bitrate(uint32_t max_bitrate) { m_max_bitrate = max_bitrate; }
+	void set_buffer_size(uint32_t buffer_size) { m_buffer_size = buffer_size; }
+	void set_roi(bool roi) { m_roi = roi; }
+	void set_keyframe_policy(KeyframePolicy policy) { m_keyframe_policy = policy; }
+	void set_keyframe_interval(int32_t frames) { m_keyframe_interval = frames; }
+	void set_write_buffer(int32_t buffer_size, int32_t buffer_count) { m_write_buffer_size = buffer_size; m_write_buffer_count = buffer_count; }
+	void set_preallocate(int64_t bytes) { m_preallocate = bytes; }
+	// output files are written no faster than bytes_per_second, benchmarks use it as a slow disk, 0 for full speed
+	void set_write_rate(int64_t bytes_per_second) { m_write_rate = bytes_per_second; }
+	// start a new file every seconds or bytes, whichever comes first, 0 to disable either limit
+	void set_segment(int32_t seconds, int64_t bytes) { m_segment_seconds = seconds; m_segment_bytes = bytes; }
+	// FrameInfo capture times are relative to origin
+	void set_clock_origin(std::chrono::steady_clock::time_point origin) { m_clock_origin = origin; }
+	// keep the last seconds of encoded output in memory, 0 to disable, max_bytes 0 for no size bound
+	void set_replay(int32_t seconds, int64_t max_bytes) { m_replay_seconds = seconds; m_replay_max_bytes = max_bytes; }
+	void set_packet_callback(PacketCallback callback) { m_packet_callback = callback; }
+	// convert, encode, mux and write timings and encoded frame counts, the file output shares it, nullptr to disable
+	void set_stats(PipelineStats* stats) { m_stats = stats; }
+
+	EncoderMode get_mode() { return m_mode; }
+	static const char* get_mode_name(EncoderMode mode);
+	// inverse of the get_*_name functions, false for an unknown name
+	static bool parse_mode_name(const char* name, EncoderMode* mode);
+	int64_t get_submitted_frames() { return m_submitted_frames; }
+	int64_t get_encoded_packets() { return m_encoded_packets; }
+	int64_t get_encoded_bytes() { return m_encoded_bytes; }
+	static const char* get_rate_control_name(RateControl rate_control);
+	static bool parse_rate_control_name(const char* name, RateControl* rate_control);
+	int64_t get_average_bitrate();
+	int64_t get_min_window_bitrate() { return m_min_window_bitrate; }
+	int64_t get_max_window_bitrate() { return m_max_window_bitrate; }
+	static const char* get_keyframe_policy_name(KeyframePolicy policy);
+	static bool parse_keyframe_policy_name(const char* name, KeyframePolicy* policy);
+	int32_t get_segment_count() { return m_segment_count; }
+	int64_t get_flush_us() { return m_flush_us; }
+	bool is_flush_truncated() { return m_flush_truncated; }
+
+	// force an IDR on the next frame, markers also become chapters in the output
+	void request_keyframe();
+	void add_marker(const char* title);
+
+	// writes the buffered replay window to a file without stalling encoding
+	int32_t save_replay(const char* filename, ReplaySaveCallback callback);
+	ReplayBuffer* get_replay() { return m_replay; }
+
+	// MPEG-TS copy of the same packets to udp:// or tcp://, alongside the file or replay output
+	int32_t live_open(const char* url, int32_t mux_delay_ms, int64_t pace_bitrate);
+	LiveOutput* get_live() { return m_live; }
+	// fMP4 segments and a playlist renamed into place, .m3u8 for HLS or .mpd for DASH, list_size 0 keeps every segment
+	int32_t playlist_open(const char* playlist, int32_t segment_seconds, int32_t list_size);
+
+	void output_thread();
+	int32_t initialize();
+	int32_t encode_frame(uint8_t* buffer, const FrameInfo& info);
+	int32_t encode_duplicate(int64_t pts);
+	int32_t output_open(const char* filename);
+	int32_t output_close(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+private:
+	void apply_mode(const AVCodec* codec);
+	void apply_rate_control();
+	void apply_keyframe_policy();
+	void update_bitrate_window(AVPacket* pkt);
+	int32_t attach_regions(const FrameInfo* info);
+	void apply_keyframe_request();
+	int32_t write_chapters(Muxer* output, int64_t start_pts, int64_t end_pts);
+	int32_t open_muxer(const char* filename, int64_t timestamp_offset);
+	void roll_segment(int64_t pts);
+	void wait_segment_closed();
+	int32_t get_pool_frame();
+	int32_t submit_frame();
+	int32_t receive_packets();
+	void write_packet(AVPacket* pkt);
+
+	Muxer* m_output;
+	ReplayBuffer* m_replay;
+	LiveOutput* m_live;
+	LiveOutput* m_playlist;
+	PacketCallback m_packet_callback;
+	AVCodecContext* m_codec_context;
+	SwsContext* m_swsctx;
+	AVFrame* m_frame;
+	AVBufferPool* m_frame_pool;
+	AVFrameSideData* m_roi_side_data;	// owned by m_frame
+	AVPacket* m_packet;
+
+	int32_t m_width;
+	int32_t m_height;
+	int32_t m_output_width;
+	int32_t m_output_height;
+	int32_t m_bytepixel;
+	int32_t m_fps;
+	int32_t m_bitrate;
+	int32_t m_frame_length;
+	EncoderMode m_mode;
+	RateControl m_rate_control;
+	int32_t m_crf;
+	int32_t m_max_bitrate;
+	int32_t m_buffer_size;
+	bool m_roi;
+	KeyframePolicy m_keyframe_policy;
+	int32_t m_keyframe_interval;
+	int32_t m_write_buffer_size;
+	int32_t m_write_buffer_count;
+	int64_t m_preallocate;
+	int64_t m_write_rate;
+	int32_t m_segment_seconds;
+	int64_t m_segment_bytes;
+	int32_t m_replay_seconds;
+	int64_t m_replay_max_bytes;
+	PipelineStats* m_stats;
+	int64_t m_encode_us;		// encoder time of the frame being submitted, muxing excluded
+
+	int64_t m_submitted_frames;
+	int64_t m_encoded_packets;
+	int64_t m_encoded_bytes;
+	int64_t m_first_pts;
+	int64_t m_last_pts;
+
+	// bitrate over one second windows of decode time
+	int64_t m_window_start;
+	int64_t m_window_bytes;
+	int64_t m_min_window_bitrate;
+	int64_t m_max_window_bitrate;
+
+	std::chrono::steady_clock::time_point m_clock_origin;
+	int64_t m_capture_times[CAPTURE_TIME_SLOTS];	// capture_us by pts
+	int64_t m_present_times[CAPTURE_TIME_SLOTS];	// present_us by pts, -1 for repeated pictures
+
+	// IDR forced every playlist segment when the GOP does not line up with it
+	int32_t m_playlist_keyframe_frames;
+	int64_t m_next_playlist_keyframe;
+
+	std::atomic<bool> m_keyframe_requested;
+	std::mutex m_marker_mutex;
+	std::vector<EncoderMarker> m_markers;
+
+	// segmentation, the previous segment is finalized on its own thread
+	std::string m_output_filename;
+	int64_t m_segment_start_pts;
+	int64_t m_segment_start_bytes;
+	int32_t m_segment_count;
+	bool m_segment_rollover;
+	std::thread m_segment_thread;
+
+	int64_t m_flush_us;
+	bool m_flush_truncated;
+
+	bool m_output_running;
+	std::thread m_output_thread;
+};
+
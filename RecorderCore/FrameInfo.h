@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_FRAME_REGIONS 16
+
+// rectangle in frame pixel coordinates, right and bottom exclusive
+struct FrameRegion
+{
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+};
+
+// per frame metadata carried from capture to encode
+struct FrameInfo
+{
+	int64_t pts;			// presentation timestamp in frame intervals since record start
+	int64_t capture_us;		// capture time in microseconds since record start
+	int64_t present_us;		// time the source produced the picture on the same clock, -1 for a picture seen before
+
+	// regions changed since the previous frame, -1 when unknown
+	int32_t region_count;
+	FrameRegion regions[MAX_FRAME_REGIONS];
+
+	bool cursor_visible;
+	FrameRegion cursor;		// area around the mouse pointer
+};
@@ -0,0 +1,55 @@
+#include "pch.h"
+#include "FrameKernels.h"
+
+void copy_rows(uint8_t* dst, const uint8_t* src, int64_t src_pitch, int64_t row_bytes, int32_t rows)
+{
+	// unpadded source, one copy of the whole frame
+	if (src_pitch == row_bytes)
+	{
+		memcpy(dst, src, row_bytes * rows);
+		return;
+	}
+
+	for (int32_t row = 0; row < rows; row++)
+	{
+		memcpy(dst, src, row_bytes);
+		dst += row_bytes;
+		src += src_pitch;
+	}
+}
+
+void add_frame_region(FrameRegion* regions, int32_t* count, const FrameRegion& region)
+{
+	if (*count < 0)
+	{
+		return;
+	}
+
+	if (*count < MAX_FRAME_REGIONS)
+	{
+		regions[(*count)++] = region;
+		return;
+	}
+
+	// list is full, merge into the region that grows the least
+	int32_t best = 0;
+	int64_t best_growth = INT64_MAX;
+	for (int32_t i = 0; i < *count; i++)
+	{
+		FrameRegion& r = regions[i];
+		int64_t area = (int64_t)(r.right - r.left) * (r.bottom - r.top);
+		int64_t merged = (int64_t)((r.right > region.right ? r.right : region.right) - (r.left < region.left ? r.left : region.left)) *
+			((r.bottom > region.bottom ? r.bottom : region.bottom) - (r.top < region.top ? r.top : region.top));
+		if (merged - area < best_growth)
+		{
+			best_growth = merged - area;
+			best = i;
+		}
+	}
+
+	FrameRegion& r = regions[best];
+	if (region.left < r.left) r.left = region.left;
+	if (region.top < r.top) r.top = region.top;
+	if (region.right > r.right) r.right = region.right;
+	if (region.bottom > r.bottom) r.bottom = region.bottom;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "FrameInfo.h"
+
+// frame level helpers shared by the capture sources, kept free of platform types so they can be benchmarked anywhere
+
+// packs rows of row_bytes read every src_pitch bytes, such as a mapped GPU texture, into a contiguous dst
+void copy_rows(uint8_t* dst, const uint8_t* src, int64_t src_pitch, int64_t row_bytes, int32_t rows);
+
+// adds region to a list of *count entries, once MAX_FRAME_REGIONS are used it is merged into the entry that
+// grows the least, a negative count means unknown and stays unknown
+void add_frame_region(FrameRegion* regions, int32_t* count, const FrameRegion& region);
@@ -0,0 +1,189 @@
+#include "pch.h"
+#include "FrameQueue.h"
+
+FrameQueue::FrameQueue() :
+	m_policy(FRAME_POLICY_DUPLICATE_LAST),
+	m_capacity(0),
+	m_slot_count(0),
+	m_buffers(nullptr),
+	m_infos(nullptr),
+	m_ready(nullptr),
+	m_ready_head(0),
+	m_ready_count(0),
+	m_free(nullptr),
+	m_free_count(0),
+	m_push_slot(-1),
+	m_pop_slot(-1),
+	m_dropped_frames(0),
+	m_closed(false)
+{
+
+}
+
+FrameQueue::~FrameQueue()
+{
+	if (m_buffers)
+	{
+		for (int32_t i = 0; i < m_slot_count; i++)
+		{
+			delete[] m_buffers[i];
+		}
+		delete[] m_buffers;
+		m_buffers = nullptr;
+	}
+
+	if (m_infos) delete[] m_infos;
+	if (m_ready) delete[] m_ready;
+	if (m_free) delete[] m_free;
+}
+
+const char* FrameQueue::get_policy_name(FramePolicy policy)
+{
+	switch (policy)
+	{
+	case FRAME_POLICY_DROP_NEWEST:
+		return "drop-newest";
+	case FRAME_POLICY_DROP_OLDEST:
+		return "drop-oldest";
+	case FRAME_POLICY_DUPLICATE_LAST:
+		return "duplicate-last";
+	}
+
+	return "unknown frame policy";
+}
+
+bool FrameQueue::parse_policy_name(const char* name, FramePolicy* policy)
+{
+	for (int32_t i = FRAME_POLICY_DROP_NEWEST; i <= FRAME_POLICY_DUPLICATE_LAST; i++)
+	{
+		if (strcmp(name, get_policy_name((FramePolicy)i)) == 0)
+		{
+			*policy = (FramePolicy)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int32_t FrameQueue::initialize(int32_t capacity, int32_t frame_length, FramePolicy policy)
+{
+	if (capacity <= 0 || frame_length <= 0)
+	{
+		TRACE(_T("frame queue size invalid\n"));
+		return -1;
+	}
+
+	m_policy = policy;
+	m_capacity = capacity;
+
+	// one extra slot for the frame being captured and one for the frame being encoded
+	m_slot_count = capacity + 2;
+	m_buffers = new uint8_t*[m_slot_count];
+	m_infos = new FrameInfo[m_slot_count];
+	m_ready = new int32_t[m_capacity];
+	m_free = new int32_t[m_slot_count];
+
+	for (int32_t i = 0; i < m_slot_count; i++)
+	{
+		m_buffers[i] = new uint8_t[frame_length];
+		m_free[i] = i;
+	}
+	m_free_count = m_slot_count;
+	m_ready_head = 0;
+	m_ready_count = 0;
+
+	return 0;
+}
+
+uint8_t* FrameQueue::begin_push()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_ready_count == m_capacity)
+	{
+		if (m_policy != FRAME_POLICY_DROP_OLDEST)
+		{
+			// skip the capture copy entirely, the queue cannot take it
+			if (m_policy == FRAME_POLICY_DROP_NEWEST) m_dropped_frames++;
+			return nullptr;
+		}
+
+		// evict oldest queued frame
+		m_free[m_free_count++] = m_ready[m_ready_head];
+		m_ready_head = (m_ready_head + 1) % m_capacity;
+		m_ready_count--;
+		m_dropped_frames++;
+	}
+
+	m_push_slot = m_free[--m_free_count];
+
+	return m_buffers[m_push_slot];
+}
+
+void FrameQueue::end_push(const FrameInfo& info)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_push_slot < 0)
+		{
+			return;
+		}
+
+		m_infos[m_push_slot] = info;
+		m_ready[(m_ready_head + m_ready_count) % m_capacity] = m_push_slot;
+		m_ready_count++;
+		m_push_slot = -1;
+	}
+
+	m_cond.notify_one();
+}
+
+uint8_t* FrameQueue::pop(FrameInfo* info, int32_t timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (!m_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [=]() { return m_ready_count > 0 || m_closed; }) ||
+		m_ready_count == 0)
+	{
+		return nullptr;
+	}
+
+	m_pop_slot = m_ready[m_ready_head];
+	m_ready_head = (m_ready_head + 1) % m_capacity;
+	m_ready_count--;
+
+	*info = m_infos[m_pop_slot];
+
+	return m_buffers[m_pop_slot];
+}
+
+void FrameQueue::release()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_pop_slot >= 0)
+	{
+		m_free[m_free_count++] = m_pop_slot;
+		m_pop_slot = -1;
+	}
+}
+
+void FrameQueue::close(std::chrono::steady_clock::time_point deadline)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_deadline = deadline;
+		m_closed = true;
+	}
+
+	m_cond.notify_all();
+}
+
+int32_t FrameQueue::get_depth()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_ready_count;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "FrameInfo.h"
+
+// what to do with a captured frame when the encoder falls behind and the queue is full
+enum FramePolicy
+{
+	FRAME_POLICY_DROP_NEWEST,		// discard the incoming frame
+	FRAME_POLICY_DROP_OLDEST,		// evict the oldest queued frame to make room
+	FRAME_POLICY_DUPLICATE_LAST,	// discard the incoming frame, encoder repeats the last frame in its place
+};
+
+// bounded queue of preallocated raw frame buffers between capture and encode
+class FrameQueue
+{
+public:
+	FrameQueue();
+	~FrameQueue();
+
+	int32_t initialize(int32_t capacity, int32_t frame_length, FramePolicy policy);
+
+	// producer side : returns nullptr when the frame must be skipped
+	uint8_t* begin_push();
+	void end_push(const FrameInfo& info);
+
+	// consumer side : returned buffer stays valid until release()
+	uint8_t* pop(FrameInfo* info, int32_t timeout_ms);
+	void release();
+
+	// no more frames will be pushed, the consumer drains what is queued until the deadline
+	void close(std::chrono::steady_clock::time_point deadline);
+	bool is_closed() { return m_closed; }
+	bool is_past_deadline() { return m_closed && std::chrono::steady_clock::now() > m_deadline; }
+
+	FramePolicy get_policy() { return m_policy; }
+	static const char* get_policy_name(FramePolicy policy);
+	// inverse of get_policy_name, false for an unknown name
+	static bool parse_policy_name(const char* name, FramePolicy* policy);
+	int32_t get_depth();
+	int64_t get_dropped_frames() { return m_dropped_frames; }
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+
+	FramePolicy m_policy;
+	int32_t m_capacity;
+	int32_t m_slot_count;
+	uint8_t** m_buffers;
+	FrameInfo* m_infos;
+
+	int32_t* m_ready;		// ring of queued slot indexes
+	int32_t m_ready_head;
+	int32_t m_ready_count;
+	int32_t* m_free;		// stack of unused slot indexes
+	int32_t m_free_count;
+	int32_t m_push_slot;
+	int32_t m_pop_slot;
+
+	std::atomic<int64_t> m_dropped_frames;
+	std::atomic<bool> m_closed;
+	std::chrono::steady_clock::time_point m_deadline;
+};
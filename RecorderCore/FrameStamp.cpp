@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "FrameStamp.h"
+
+// CRC-8 with polynomial x^8 + x^2 + x + 1 over the payload bytes, the non zero start rejects an all black corner
+static uint8_t stamp_check(uint64_t payload)
+{
+	uint8_t crc = 0xFF;
+
+	for (int32_t i = 0; i < 8; i++)
+	{
+		crc ^= (uint8_t)(payload >> (i * 8));
+		for (int32_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+void paint_frame_stamp(uint8_t* bgra, int64_t pitch, const FrameStamp& stamp)
+{
+	uint64_t payload = ((uint64_t)stamp.sequence & ((1ULL << FRAME_STAMP_SEQUENCE_BITS) - 1)) |
+		(((uint64_t)stamp.time_us & ((1ULL << FRAME_STAMP_TIME_BITS) - 1)) << FRAME_STAMP_SEQUENCE_BITS);
+	uint8_t check = stamp_check(payload);
+
+	for (int32_t i = 0; i < FRAME_STAMP_BITS; i++)
+	{
+		bool set = i < 64 ? ((payload >> i) & 1) != 0 : ((check >> (i - 64)) & 1) != 0;
+		uint32_t color = set ? 0xFFFFFFFF : 0xFF000000;
+		int32_t left = (i % FRAME_STAMP_COLUMNS) * FRAME_STAMP_CELL;
+		int32_t top = (i / FRAME_STAMP_COLUMNS) * FRAME_STAMP_CELL;
+
+		for (int32_t y = top; y < top + FRAME_STAMP_CELL; y++)
+		{
+			uint32_t* p = (uint32_t*)(bgra + y * pitch) + left;
+			for (int32_t x = 0; x < FRAME_STAMP_CELL; x++)
+			{
+				p[x] = color;
+			}
+		}
+	}
+}
+
+bool read_frame_stamp(const uint8_t* luma, int64_t linesize, FrameStamp* stamp)
+{
+	uint64_t payload = 0;
+	uint8_t check = 0;
+
+	for (int32_t i = 0; i < FRAME_STAMP_BITS; i++)
+	{
+		// the cell centre only, edges blur into the neighbours
+		int32_t left = (i % FRAME_STAMP_COLUMNS) * FRAME_STAMP_CELL + FRAME_STAMP_CELL / 4;
+		int32_t top = (i / FRAME_STAMP_COLUMNS) * FRAME_STAMP_CELL + FRAME_STAMP_CELL / 4;
+		int32_t sum = 0;
+
+		for (int32_t y = top; y < top + FRAME_STAMP_CELL / 2; y++)
+		{
+			const uint8_t* p = luma + y * linesize + left;
+			for (int32_t x = 0; x < FRAME_STAMP_CELL / 2; x++)
+			{
+				sum += p[x];
+			}
+		}
+
+		if (sum < 128 * (FRAME_STAMP_CELL / 2) * (FRAME_STAMP_CELL / 2))
+		{
+			continue;
+		}
+
+		if (i < 64) payload |= 1ULL << i;
+		else check |= (uint8_t)(1 << (i - 64));
+	}
+
+	if (stamp_check(payload) != check)
+	{
+		return false;
+	}
+
+	stamp->sequence = (int64_t)(payload & ((1ULL << FRAME_STAMP_SEQUENCE_BITS) - 1));
+	stamp->time_us = (int64_t)(payload >> FRAME_STAMP_SEQUENCE_BITS);
+
+	return true;
+}
+
+int64_t unwrap_frame_stamp_time(int64_t stamp_time_us, int64_t reference_us)
+{
+	const int64_t range = 1LL << FRAME_STAMP_TIME_BITS;
+	int64_t time_us = (reference_us & ~(range - 1)) | stamp_time_us;
+
+	if (time_us - reference_us > range / 2) time_us -= range;
+	else if (reference_us - time_us > range / 2) time_us += range;
+
+	return time_us;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+// a frame stamp is a grid of black and white cells in the top left corner of a picture, one bit per cell, large enough
+// to survive 4:2:0 subsampling, scaling free encoding at low bitrates and being read back from the decoded luma plane
+#define FRAME_STAMP_SEQUENCE_BITS 16
+#define FRAME_STAMP_TIME_BITS 48
+#define FRAME_STAMP_CHECK_BITS 8
+#define FRAME_STAMP_BITS (FRAME_STAMP_SEQUENCE_BITS + FRAME_STAMP_TIME_BITS + FRAME_STAMP_CHECK_BITS)
+#define FRAME_STAMP_COLUMNS 8
+#define FRAME_STAMP_CELL 16
+#define FRAME_STAMP_WIDTH (FRAME_STAMP_COLUMNS * FRAME_STAMP_CELL)
+#define FRAME_STAMP_HEIGHT (FRAME_STAMP_BITS / FRAME_STAMP_COLUMNS * FRAME_STAMP_CELL)
+
+struct FrameStamp
+{
+	int64_t sequence;		// picture counter of the source, kept modulo 2^FRAME_STAMP_SEQUENCE_BITS
+	int64_t time_us;		// steady clock time the picture was produced, kept modulo 2^FRAME_STAMP_TIME_BITS
+};
+
+// paints stamp into a BGRA picture of pitch bytes per row, at least FRAME_STAMP_WIDTH x FRAME_STAMP_HEIGHT
+void paint_frame_stamp(uint8_t* bgra, int64_t pitch, const FrameStamp& stamp);
+
+// reads a stamp back from an 8 bit luma plane, false when no valid stamp is found
+bool read_frame_stamp(const uint8_t* luma, int64_t linesize, FrameStamp* stamp);
+
+// the full steady clock time closest to reference that matches a stamp time, reference on the same clock in microseconds
+int64_t unwrap_frame_stamp_time(int64_t stamp_time_us, int64_t reference_us);
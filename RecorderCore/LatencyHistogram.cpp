@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+void LatencyHistogram::reset()
+{
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+	for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		m_buckets[i] = 0;
+	}
+}
+
+int32_t LatencyHistogram::get_bucket(int64_t value)
+{
+	int32_t magnitude = HISTOGRAM_SUB_BUCKET_BITS + 1;
+
+	if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+	{
+		return (int32_t)value;
+	}
+
+	// position of the highest set bit, the next HISTOGRAM_SUB_BUCKET_BITS bits select the sub bucket
+	while ((value >> (magnitude + 1)) != 0)
+	{
+		magnitude++;
+	}
+
+	int32_t shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+	return 2 * HISTOGRAM_SUB_BUCKETS + (magnitude - HISTOGRAM_SUB_BUCKET_BITS - 1) * HISTOGRAM_SUB_BUCKETS +
+		(int32_t)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+int64_t LatencyHistogram::get_bucket_limit(int32_t bucket)
+{
+	if (bucket < 2 * HISTOGRAM_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	int32_t magnitude = (bucket - 2 * HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS + 1;
+	int64_t top = (bucket - 2 * HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+	int32_t shift = magnitude - HISTOGRAM_SUB_BUCKET_BITS;
+
+	return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t value_us)
+{
+	if (value_us < 0) value_us = 0;
+	if (value_us >= ((int64_t)1 << HISTOGRAM_MAX_MAGNITUDE)) value_us = ((int64_t)1 << HISTOGRAM_MAX_MAGNITUDE) - 1;
+
+	m_buckets[get_bucket(value_us)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value_us, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+
+	int64_t largest = m_max.load(std::memory_order_relaxed);
+	while (value_us > largest && !m_max.compare_exchange_weak(largest, value_us, std::memory_order_relaxed))
+	{
+	}
+}
+
+int64_t LatencyHistogram::get_percentile(double percentile)
+{
+	int64_t total = 0;
+	int64_t count = 0;
+
+	// the buckets are summed instead of using m_count so a concurrent record cannot push the rank past the end
+	for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		total += m_buckets[i].load(std::memory_order_relaxed);
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	int64_t rank = (int64_t)(total * percentile / 100.0 + 0.5);
+	if (rank < 1) rank = 1;
+
+	for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		count += m_buckets[i].load(std::memory_order_relaxed);
+		if (count >= rank)
+		{
+			// never report more than was actually seen
+			int64_t limit = get_bucket_limit(i);
+			int64_t largest = m_max;
+			return limit < largest ? limit : largest;
+		}
+	}
+
+	return m_max;
+}
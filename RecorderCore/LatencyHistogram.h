@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+// log-linear buckets : values below 2 * HISTOGRAM_SUB_BUCKETS are exact, above that every power of two
+// is split into HISTOGRAM_SUB_BUCKETS so the relative error stays under 1 / HISTOGRAM_SUB_BUCKETS
+#define HISTOGRAM_SUB_BUCKETS 32
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+// largest recorded value is 2^HISTOGRAM_MAX_MAGNITUDE - 1 microseconds, about 35 minutes, larger values are clamped
+#define HISTOGRAM_MAX_MAGNITUDE 31
+#define HISTOGRAM_BUCKETS (2 * HISTOGRAM_SUB_BUCKETS + (HISTOGRAM_MAX_MAGNITUDE - HISTOGRAM_SUB_BUCKET_BITS - 1) * HISTOGRAM_SUB_BUCKETS)
+
+// HDR style histogram of microsecond durations, record is wait free so any thread can add values
+// while another one reads percentiles
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void record(int64_t value_us);
+	void reset();
+
+	int64_t get_count() { return m_count; }
+	int64_t get_mean() { int64_t count = m_count; return count > 0 ? m_sum / count : 0; }
+	int64_t get_max() { return m_max; }
+	// upper bound of the bucket holding the value at percentile
+	int64_t get_percentile(double percentile);
+
+private:
+	static int32_t get_bucket(int64_t value);
+	static int64_t get_bucket_limit(int32_t bucket);
+
+	std::atomic<int64_t> m_count;
+	std::atomic<int64_t> m_sum;
+	std::atomic<int64_t> m_max;
+	std::atomic<int64_t> m_buckets[HISTOGRAM_BUCKETS];
+};
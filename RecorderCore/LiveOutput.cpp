@@ -0,0 +1,253 @@
+#include "pch.h"
+#include "LiveOutput.h"
+#include "Muxer.h"
+
+// whole TS packets per UDP datagram
+#define LIVE_UDP_PACKET_SIZE "1316"
+// time the sender gets to push queued packets out on close before blocking I/O is aborted
+#define LIVE_CLOSE_GRACE_MS 1000
+
+LiveOutput::LiveOutput() :
+	m_format("mpegts"),
+	m_format_options(nullptr),
+	m_codecpar(nullptr),
+	m_time_base({ 0, 1 }),
+	m_mux_delay_ms(0),
+	m_pace_bitrate(0),
+	m_lossless(false),
+	m_running(false),
+	m_finished(false),
+	m_abort(false),
+	m_wait_keyframe(true),
+	m_sent_packets(0),
+	m_dropped_packets(0),
+	m_latency_us_sum(0),
+	m_max_latency_us(0)
+{
+
+}
+
+LiveOutput::~LiveOutput()
+{
+	close();
+
+	if (m_codecpar)
+	{
+		avcodec_parameters_free(&m_codecpar);
+		m_codecpar = nullptr;
+	}
+
+	av_dict_free(&m_format_options);
+}
+
+int32_t LiveOutput::open(const char* url, const AVCodecContext* codec_context, int32_t mux_delay_ms, int64_t pace_bitrate)
+{
+	m_codecpar = avcodec_parameters_alloc();
+	if (!m_codecpar || avcodec_parameters_from_context(m_codecpar, codec_context) < 0)
+	{
+		TRACE(_T("cannot copy codec parameters\n"));
+		return -1;
+	}
+
+	// one extra slot for the packet that makes the queue overflow before the oldest ones are dropped
+	if (m_queue.initialize(LIVE_QUEUE_PACKETS + 1) < 0)
+	{
+		return -1;
+	}
+
+	m_url = url;
+	m_time_base = codec_context->time_base;
+	m_mux_delay_ms = mux_delay_ms;
+	m_pace_bitrate = pace_bitrate;
+
+	// connecting may block, a tcp listener waits for its client, so it happens on the send thread
+	m_running = true;
+	m_send_thread = std::move(std::thread([=]() {
+		send_thread();
+		}));
+
+	return 0;
+}
+
+int32_t LiveOutput::push(const AVPacket* pkt, std::chrono::steady_clock::time_point capture_time)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		// backpressure, the encoder waits for the sender rather than losing a packet
+		if (m_lossless)
+		{
+			m_space_cond.wait(lock, [=]() { return m_queue.size() < LIVE_QUEUE_PACKETS || !m_running; });
+		}
+
+		if (!m_running)
+		{
+			return -1;
+		}
+
+		// a viewer can only start decoding on a keyframe
+		if (m_wait_keyframe)
+		{
+			if (!(pkt->flags & AV_PKT_FLAG_KEY))
+			{
+				m_dropped_packets++;
+				return 0;
+			}
+			m_wait_keyframe = false;
+		}
+
+		if (m_queue.push(pkt, capture_time) < 0)
+		{
+			return -1;
+		}
+
+		// socket fell behind, skip ahead to the next keyframe instead of adding delay
+		if (m_queue.size() > LIVE_QUEUE_PACKETS)
+		{
+			drop_until_keyframe();
+		}
+	}
+
+	m_cond.notify_one();
+
+	return 0;
+}
+
+void LiveOutput::drop_until_keyframe()
+{
+	do
+	{
+		m_queue.pop_front(nullptr);
+		m_dropped_packets++;
+	} while (!m_queue.empty() && !(m_queue.front().pkt->flags & AV_PKT_FLAG_KEY));
+
+	if (m_queue.empty())
+	{
+		m_wait_keyframe = true;
+	}
+}
+
+static int live_interrupt(void* opaque)
+{
+	return *reinterpret_cast<std::atomic<bool>*>(opaque) ? 1 : 0;
+}
+
+void LiveOutput::send_thread()
+{
+	Muxer muxer;
+	AVPacket* pkt = av_packet_alloc();
+	std::chrono::steady_clock::time_point capture_time;
+	char value[32] = { 0, };
+	bool udp = m_url.compare(0, 6, "udp://") == 0;
+	AVDictionaryEntry* option = nullptr;
+
+	// small writes straight to the socket, the TS mux delay is the only buffering
+	muxer.set_format(m_format.c_str());
+	while ((option = av_dict_get(m_format_options, "", option, AV_DICT_IGNORE_SUFFIX)) != nullptr)
+	{
+		muxer.set_format_option(option->key, option->value);
+	}
+	muxer.set_write_buffer(0, 0);
+	muxer.set_max_delay(m_mux_delay_ms * 1000);
+	muxer.set_flush_packets(true);
+	muxer.set_interrupt(live_interrupt, &m_abort);
+	if (udp)
+	{
+		muxer.set_io_option("pkt_size", LIVE_UDP_PACKET_SIZE);
+		if (m_pace_bitrate > 0)
+		{
+			snprintf(value, sizeof(value), "%lld", (long long)m_pace_bitrate);
+			muxer.set_io_option("bitrate", value);
+		}
+	}
+
+	if (!pkt)
+	{
+		TRACE(_T("cannot allocate %s packet\n"), m_format.c_str());
+	}
+	else if (muxer.open(m_url.c_str(), m_codecpar, m_time_base) < 0)
+	{
+		TRACE(_T("cannot open %s output %s\n"), m_format.c_str(), m_url.c_str());
+	}
+	else
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		// packets queued while connecting are stale, resume at the next keyframe
+		if (!m_lossless && !m_queue.empty() && !(m_queue.front().pkt->flags & AV_PKT_FLAG_KEY))
+		{
+			drop_until_keyframe();
+		}
+
+		for (;;)
+		{
+			m_cond.wait(lock, [=]() { return !m_queue.empty() || !m_running; });
+			if (m_queue.empty())
+			{
+				break;
+			}
+
+			// the queue slot is reused right away, the reference moves to the packet of this thread
+			capture_time = m_queue.front().capture_time;
+			m_queue.pop_front(pkt);
+			lock.unlock();
+			m_space_cond.notify_one();
+
+			int32_t ret = muxer.write_packet(pkt);
+			av_packet_unref(pkt);
+
+			if (ret == 0)
+			{
+				int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - capture_time).count();
+				m_latency_us_sum += latency_us;
+				if (latency_us > m_max_latency_us) m_max_latency_us = latency_us;
+				m_sent_packets++;
+			}
+			else
+			{
+				m_dropped_packets++;
+			}
+
+			lock.lock();
+		}
+	}
+
+	muxer.close();
+	av_packet_free(&pkt);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+		m_finished = true;
+	}
+	m_cond.notify_all();
+	m_space_cond.notify_all();
+}
+
+void LiveOutput::close()
+{
+	if (!m_send_thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_running = false;
+		m_cond.notify_all();
+		m_space_cond.notify_all();
+
+		// queued packets still go out unless the socket stays blocked, a lossless output drains whatever it takes
+		if (!m_lossless && !m_cond.wait_for(lock, std::chrono::milliseconds(LIVE_CLOSE_GRACE_MS), [=]() { return m_finished; }))
+		{
+			m_abort = true;
+		}
+	}
+
+	m_send_thread.join();
+
+	TRACE(_T("%s %s : %lld packets sent, %lld dropped, latency avg %lld max %lld us\n"), m_format.c_str(), m_url.c_str(),
+		(long long)m_sent_packets.load(), (long long)m_dropped_packets.load(), (long long)get_average_latency_us(),
+		(long long)m_max_latency_us.load());
+}
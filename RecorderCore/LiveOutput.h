@@ -0,0 +1,73 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "PacketQueue.h"
+
+// packets waiting for the socket, older ones are dropped up to the next keyframe, or push waits when lossless
+#define LIVE_QUEUE_PACKETS 120
+
+// MPEG-TS over udp:// or tcp:// fed from the encoded packets, the network never blocks the encoder,
+// other formats such as hls or dash reuse the same sender with their own muxer options
+// and run lossless since their segments are files a player fetches later
+class LiveOutput
+{
+public:
+	LiveOutput();
+	~LiveOutput();
+
+	void set_format(const char* format) { m_format = format; }
+	void set_format_option(const char* key, const char* value) { av_dict_set(&m_format_options, key, value, 0); }
+	// every packet is written : push waits for the sender once the queue is full and close waits for the
+	// queue to drain instead of aborting blocked I/O
+	void set_lossless(bool lossless) { m_lossless = lossless; }
+
+	// mux_delay_ms bounds the TS mux delay, pace_bitrate spreads UDP datagrams at that rate, 0 sends at once
+	int32_t open(const char* url, const AVCodecContext* codec_context, int32_t mux_delay_ms, int64_t pace_bitrate);
+	int32_t push(const AVPacket* pkt, std::chrono::steady_clock::time_point capture_time);
+	void close();
+
+	int64_t get_sent_packets() { return m_sent_packets; }
+	int64_t get_dropped_packets() { return m_dropped_packets; }
+	// capture of the frame to its packet handed to the socket
+	int64_t get_average_latency_us() { return m_sent_packets ? m_latency_us_sum / m_sent_packets : 0; }
+	int64_t get_max_latency_us() { return m_max_latency_us; }
+
+private:
+	void send_thread();
+	void drop_until_keyframe();
+
+	std::string m_url;
+	std::string m_format;
+	AVDictionary* m_format_options;
+	AVCodecParameters* m_codecpar;
+	AVRational m_time_base;
+	int32_t m_mux_delay_ms;
+	int64_t m_pace_bitrate;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::condition_variable m_space_cond;	// lossless push waiting for the sender
+	PacketQueue m_queue;
+	bool m_lossless;
+	bool m_running;
+	bool m_finished;
+	std::atomic<bool> m_abort;
+	bool m_wait_keyframe;
+	std::thread m_send_thread;
+
+	std::atomic<int64_t> m_sent_packets;
+	std::atomic<int64_t> m_dropped_packets;
+	std::atomic<int64_t> m_latency_us_sum;
+	std::atomic<int64_t> m_max_latency_us;
+};
@@ -0,0 +1,230 @@
+#include "pch.h"
+#include "Muxer.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+Muxer::Muxer() :
+	m_output_context(nullptr),
+	m_video_stream(nullptr),
+	m_packet(nullptr),
+	m_writer(nullptr),
+	m_stats(nullptr),
+	m_reported_bytes(0),
+	m_write_buffer_size(DEFAULT_WRITE_BUFFER_SIZE),
+	m_write_buffer_count(DEFAULT_WRITE_BUFFER_COUNT),
+	m_preallocate(0),
+	m_write_rate(0),
+	m_format(nullptr),
+	m_max_delay(-1),
+	m_flush_packets(false),
+	m_io_options(nullptr),
+	m_format_options(nullptr),
+	m_interrupt({ nullptr, nullptr }),
+	m_time_base({ 0, 1 }),
+	m_timestamp_offset(0),
+	m_header_written(false)
+{
+
+}
+
+Muxer::~Muxer()
+{
+	close();
+
+	if (m_packet)
+	{
+		av_packet_free(&m_packet);
+		m_packet = nullptr;
+	}
+
+	av_dict_free(&m_io_options);
+	av_dict_free(&m_format_options);
+}
+
+int32_t Muxer::open(const char* filename, const AVCodecParameters* codecpar, AVRational time_base)
+{
+	int ret = 0;
+
+	ret = avformat_alloc_output_context2(&m_output_context, nullptr, m_format, filename);
+	if (ret < 0)
+	{
+		TRACE(_T("cannot allocate ouput context\n"));
+		return -1;
+	}
+
+	m_output_context->interrupt_callback = m_interrupt;
+	if (m_max_delay >= 0) m_output_context->max_delay = m_max_delay;
+	if (m_flush_packets) m_output_context->flush_packets = 1;
+
+	m_video_stream = avformat_new_stream(m_output_context, nullptr);
+	if (!m_video_stream)
+	{
+		TRACE(_T("cannot create new video stream\n"));
+		return -1;
+	}
+
+	avcodec_parameters_copy(m_video_stream->codecpar, codecpar);
+	m_video_stream->time_base = time_base;
+	m_time_base = time_base;
+
+	m_packet = av_packet_alloc();
+	if (!m_packet)
+	{
+		TRACE(_T("cannot allocate packet\n"));
+		return -1;
+	}
+
+	av_dump_format(m_output_context, 0, filename, 1);
+
+	if (!(m_output_context->oformat->flags & AVFMT_NOFILE) && m_write_buffer_size > 0)
+	{
+		// a slow disk only stalls the muxer once every write buffer is in flight
+		m_writer = new AsyncFileWriter();
+		m_writer->set_stats(m_stats);
+		m_writer->set_write_rate(m_write_rate);
+		if (m_writer->open(filename, m_write_buffer_size, m_write_buffer_count, m_preallocate) < 0)
+		{
+			return -1;
+		}
+		m_output_context->pb = m_writer->get_avio();
+	}
+	else if (!(m_output_context->oformat->flags & AVFMT_NOFILE)) {
+		ret = avio_open2(&m_output_context->pb, filename, AVIO_FLAG_WRITE, &m_interrupt, &m_io_options);
+		if (ret < 0) {
+			TRACE(_T("cannot open output file\n"));
+			return -1;
+		}
+	}
+
+	ret = avformat_write_header(m_output_context, &m_format_options);
+	if (ret < 0)
+	{
+		TRACE(_T("cannot write header %d\n"), ret);
+		return -1;
+	}
+	m_header_written = true;
+
+	return 0;
+}
+
+int32_t Muxer::write_packet(const AVPacket* pkt)
+{
+	int ret = 0;
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+	if (!m_header_written)
+	{
+		return -1;
+	}
+
+	// payload is shared, only timestamps of our reference are rescaled
+	ret = av_packet_ref(m_packet, pkt);
+	if (ret < 0)
+	{
+		TRACE(_T("cannot reference packet\n"));
+		return -1;
+	}
+
+	if (m_packet->pts != AV_NOPTS_VALUE) m_packet->pts -= m_timestamp_offset;
+	if (m_packet->dts != AV_NOPTS_VALUE) m_packet->dts -= m_timestamp_offset;
+	m_packet->stream_index = m_video_stream->index;
+	av_packet_rescale_ts(m_packet, m_time_base, m_video_stream->time_base);
+
+	// takes ownership of the reference
+	ret = av_interleaved_write_frame(m_output_context, m_packet);
+	if (ret < 0)
+	{
+		TRACE(_T("av_interleaved_write_frame error %d\n"), ret);
+		return -1;
+	}
+
+	if (m_stats)
+	{
+		m_stats->add_stage(PIPELINE_STAGE_MUX, t_start, pkt->pts);
+
+		// plain avio writes synchronously, pos is where its last flush ended
+		if (!m_writer && m_output_context->pb)
+		{
+			int64_t position = m_output_context->pb->pos;
+			if (position > m_reported_bytes)
+			{
+				m_stats->add_bytes_written(position - m_reported_bytes);
+				m_reported_bytes = position;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int32_t Muxer::add_chapter(int32_t id, int64_t start, int64_t end, const char* title)
+{
+	if (!m_output_context)
+	{
+		return -1;
+	}
+
+	AVChapter* chapter = reinterpret_cast<AVChapter*>(av_mallocz(sizeof(AVChapter)));
+	if (!chapter)
+	{
+		TRACE(_T("cannot allocate chapter\n"));
+		return -1;
+	}
+
+	chapter->id = id;
+	chapter->time_base = m_time_base;
+	chapter->start = start - m_timestamp_offset;
+	chapter->end = end - m_timestamp_offset;
+	av_dict_set(&chapter->metadata, "title", title, 0);
+	av_dynarray_add(&m_output_context->chapters, reinterpret_cast<int*>(&m_output_context->nb_chapters), chapter);
+
+	return 0;
+}
+
+int32_t Muxer::close()
+{
+	int32_t ret = 0;
+
+	if (!m_output_context)
+	{
+		return 0;
+	}
+
+	if (m_header_written)
+	{
+		if (av_write_trailer(m_output_context) < 0)
+		{
+			TRACE(_T("cannot write trailer\n"));
+			ret = -1;
+		}
+		m_header_written = false;
+	}
+
+	if (m_writer)
+	{
+		// context belongs to the writer
+		m_output_context->pb = nullptr;
+		if (m_writer->close() < 0)
+		{
+			TRACE(_T("failed to close output file\n"));
+			ret = -1;
+		}
+		delete m_writer;
+		m_writer = nullptr;
+	}
+	else if (!(m_output_context->oformat->flags & AVFMT_NOFILE) && m_output_context->pb) {
+		int err = avio_closep(&m_output_context->pb);
+		if (err < 0) {
+			TRACE(_T("failed to close output file\n"));
+			ret = -1;
+		}
+	}
+
+	avformat_free_context(m_output_context);
+	m_output_context = nullptr;
+	m_video_stream = nullptr;
+
+	return ret;
+}
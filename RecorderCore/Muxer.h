@@ -0,0 +1,66 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "AsyncFileWriter.h"
+
+#define DEFAULT_WRITE_BUFFER_SIZE (4 * 1024 * 1024)
+#define DEFAULT_WRITE_BUFFER_COUNT 4
+
+// one output container holding a single video stream, packets are given in codec time base
+class Muxer
+{
+public:
+	Muxer();
+	~Muxer();
+
+	// file output goes through an AsyncFileWriter unless buffer_size is 0, preallocate reserves disk space up front
+	void set_write_buffer(int32_t buffer_size, int32_t buffer_count) { m_write_buffer_size = buffer_size; m_write_buffer_count = buffer_count; }
+	void set_preallocate(int64_t bytes) { m_preallocate = bytes; }
+	// throttles the AsyncFileWriter to stand in for a slow disk, 0 for full speed
+	void set_write_rate(int64_t bytes_per_second) { m_write_rate = bytes_per_second; }
+	// network outputs : explicit format name, mux delay, protocol options and a callback aborting blocking I/O
+	void set_format(const char* format) { m_format = format; }
+	void set_max_delay(int32_t us) { m_max_delay = us; }
+	void set_flush_packets(bool flush_packets) { m_flush_packets = flush_packets; }
+	void set_io_option(const char* key, const char* value) { av_dict_set(&m_io_options, key, value, 0); }
+	void set_format_option(const char* key, const char* value) { av_dict_set(&m_format_options, key, value, 0); }
+	void set_interrupt(int (*callback)(void*), void* opaque) { m_interrupt = { callback, opaque }; }
+	// subtracted from packet and chapter timestamps, a segment cut from a running stream starts at zero
+	void set_timestamp_offset(int64_t offset) { m_timestamp_offset = offset; }
+	// packet writes, disk writes and bytes written are reported to stats, nullptr to disable
+	void set_stats(PipelineStats* stats) { m_stats = stats; }
+
+	// container is chosen by file extension
+	int32_t open(const char* filename, const AVCodecParameters* codecpar, AVRational time_base);
+	// the packet is not consumed, the muxer writes its own reference
+	int32_t write_packet(const AVPacket* pkt);
+	int32_t add_chapter(int32_t id, int64_t start, int64_t end, const char* title);
+	int32_t close();
+
+	bool is_open() { return m_output_context != nullptr; }
+
+private:
+	AVFormatContext* m_output_context;
+	AVStream* m_video_stream;
+	AVPacket* m_packet;
+	AsyncFileWriter* m_writer;
+	PipelineStats* m_stats;
+	int64_t m_reported_bytes;
+	int32_t m_write_buffer_size;
+	int32_t m_write_buffer_count;
+	int64_t m_preallocate;
+	int64_t m_write_rate;
+	const char* m_format;
+	int32_t m_max_delay;
+	bool m_flush_packets;
+	AVDictionary* m_io_options;
+	AVDictionary* m_format_options;
+	AVIOInterruptCB m_interrupt;
+	AVRational m_time_base;
+	int64_t m_timestamp_offset;
+	bool m_header_written;
+};
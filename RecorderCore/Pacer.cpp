@@ -0,0 +1,172 @@
+#include "pch.h"
+#include "Pacer.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+Pacer::Pacer() :
+	m_wait(PACER_WAIT_SLEEP),
+	m_fps(30),
+	m_next_tick(0),
+	m_oversleep_us(0),
+	m_ticks(0),
+	m_skipped_ticks(0)
+{
+#ifdef _WIN32
+	// Windows 10 1803 and later, older systems fall back to Sleep resolution plus a longer spin
+	m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+Pacer::~Pacer()
+{
+#ifdef _WIN32
+	if (m_timer)
+	{
+		CloseHandle(m_timer);
+		m_timer = nullptr;
+	}
+#endif
+}
+
+const char* Pacer::get_wait_name(PacerWait wait)
+{
+	switch (wait)
+	{
+	case PACER_WAIT_SLEEP:
+		return "sleep";
+	case PACER_WAIT_PRECISE:
+		return "precise";
+	}
+
+	return "unknown wait";
+}
+
+bool Pacer::parse_wait_name(const char* name, PacerWait* wait)
+{
+	for (int32_t i = PACER_WAIT_SLEEP; i <= PACER_WAIT_PRECISE; i++)
+	{
+		if (strcmp(name, get_wait_name((PacerWait)i)) == 0)
+		{
+			*wait = (PacerWait)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Pacer::start(int32_t fps, std::chrono::steady_clock::time_point origin)
+{
+	m_fps = fps;
+	m_origin = origin;
+	m_next_tick = 0;
+	m_oversleep_us = 0;
+
+	m_ticks = 0;
+	m_skipped_ticks = 0;
+	m_errors.reset();
+}
+
+void Pacer::resume(int64_t tick)
+{
+	m_origin = std::chrono::steady_clock::now() - std::chrono::microseconds(tick * (1 * 1000 * 1000) / m_fps);
+	m_next_tick = tick;
+}
+
+std::chrono::steady_clock::time_point Pacer::get_deadline(int64_t tick)
+{
+	return m_origin + std::chrono::microseconds(tick * (1 * 1000 * 1000) / m_fps);
+}
+
+int64_t Pacer::wait_next()
+{
+	int64_t period_us = (1 * 1000 * 1000) / m_fps;
+	std::chrono::steady_clock::time_point deadline = get_deadline(m_next_tick);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (now < deadline)
+	{
+		// wake early by the usual oversleep, a precise wait also leaves room for its spin
+		std::chrono::steady_clock::time_point target = deadline -
+			std::chrono::microseconds(m_oversleep_us + (m_wait == PACER_WAIT_PRECISE ? PACER_SPIN_US : 0));
+
+		if (target > now)
+		{
+			wait_until(target);
+			now = std::chrono::steady_clock::now();
+
+			int64_t oversleep_us = std::chrono::duration_cast<std::chrono::microseconds>(now - target).count();
+			m_oversleep_us += (oversleep_us - m_oversleep_us) / 8;
+			if (m_oversleep_us < 0) m_oversleep_us = 0;
+			if (m_oversleep_us > period_us / 2) m_oversleep_us = period_us / 2;
+		}
+
+		if (m_wait == PACER_WAIT_PRECISE)
+		{
+			while (now < deadline)
+			{
+				std::this_thread::yield();
+				now = std::chrono::steady_clock::now();
+			}
+		}
+	}
+
+	int64_t error_us = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+	m_errors.record(error_us < 0 ? -error_us : error_us);
+
+	// a late wakeup continues with the tick that is due now instead of bursting to catch up
+	int64_t tick = m_next_tick;
+	int64_t due = std::chrono::duration_cast<std::chrono::microseconds>(now - m_origin).count() * m_fps / (1 * 1000 * 1000);
+	if (due > tick)
+	{
+		m_skipped_ticks += due - tick;
+		tick = due;
+	}
+
+	m_next_tick = tick + 1;
+	m_ticks++;
+
+	return tick;
+}
+
+void Pacer::wait_until(std::chrono::steady_clock::time_point target)
+{
+	if (m_wait == PACER_WAIT_PRECISE)
+	{
+#ifdef _WIN32
+		if (m_timer)
+		{
+			LARGE_INTEGER due;
+
+			// negative due time is relative, in 100 ns units
+			due.QuadPart = -(LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(target - std::chrono::steady_clock::now()).count() / 100);
+			if (due.QuadPart < 0 && SetWaitableTimer(m_timer, &due, 0, nullptr, nullptr, FALSE))
+			{
+				WaitForSingleObject(m_timer, INFINITE);
+			}
+			return;
+		}
+#elif defined(__linux__)
+		// steady_clock is CLOCK_MONOTONIC, an absolute wakeup is not pushed back by preemption before the call
+		int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(target.time_since_epoch()).count();
+		struct timespec ts;
+		ts.tv_sec = (time_t)(ns / (1000 * 1000 * 1000));
+		ts.tv_nsec = (long)(ns % (1000 * 1000 * 1000));
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+		{
+		}
+		return;
+#endif
+	}
+
+	std::this_thread::sleep_until(target);
+}
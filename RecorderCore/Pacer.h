@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "LatencyHistogram.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// precise waits wake this long before the deadline and spin the rest
+#define PACER_SPIN_US 200
+
+// how the time left before a tick is waited out
+enum PacerWait
+{
+	PACER_WAIT_SLEEP,		// OS sleep, wakes early by the measured oversleep, no spinning
+	PACER_WAIT_PRECISE,		// high resolution timer, then a short spin up to the deadline
+};
+
+// frame ticks on absolute deadlines, tick n is due at origin + n / fps so waiting errors never accumulate
+class Pacer
+{
+public:
+	Pacer();
+	~Pacer();
+
+	void set_wait(PacerWait wait) { m_wait = wait; }
+	static const char* get_wait_name(PacerWait wait);
+	// inverse of get_wait_name, false for an unknown name
+	static bool parse_wait_name(const char* name, PacerWait* wait);
+
+	// tick 0 is due at origin, statistics restart
+	void start(int32_t fps, std::chrono::steady_clock::time_point origin);
+	// re-anchors the schedule so that tick is due now, the timeline continues after a pause
+	void resume(int64_t tick);
+	// blocks until the next tick is due and returns its index, ticks that passed while the caller was busy are skipped
+	int64_t wait_next();
+
+	std::chrono::steady_clock::time_point get_deadline(int64_t tick);
+	int64_t get_ticks() { return m_ticks; }
+	int64_t get_skipped_ticks() { return m_skipped_ticks; }
+	// absolute distance of the wakeup from the deadline
+	int64_t get_error_percentile_us(double percentile) { return m_errors.get_percentile(percentile); }
+	int64_t get_max_error_us() { return m_errors.get_max(); }
+
+private:
+	void wait_until(std::chrono::steady_clock::time_point target);
+
+	PacerWait m_wait;
+	int32_t m_fps;
+	std::chrono::steady_clock::time_point m_origin;
+	int64_t m_next_tick;
+	// running average of how late the OS wakes past the requested time, waits are shortened by it
+	int64_t m_oversleep_us;
+
+#ifdef _WIN32
+	HANDLE m_timer;
+#endif
+
+	std::atomic<int64_t> m_ticks;
+	std::atomic<int64_t> m_skipped_ticks;
+	LatencyHistogram m_errors;
+};
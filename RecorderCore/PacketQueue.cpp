@@ -0,0 +1,128 @@
+#include "pch.h"
+#include "PacketQueue.h"
+
+PacketQueue::PacketQueue() :
+	m_slots(nullptr),
+	m_capacity(0),
+	m_head(0),
+	m_count(0)
+{
+
+}
+
+PacketQueue::~PacketQueue()
+{
+	if (m_slots)
+	{
+		for (int32_t i = 0; i < m_capacity; i++)
+		{
+			av_packet_free(&m_slots[i].pkt);
+		}
+		delete[] m_slots;
+		m_slots = nullptr;
+	}
+}
+
+int32_t PacketQueue::initialize(int32_t capacity)
+{
+	if (capacity <= 0)
+	{
+		TRACE(_T("packet queue size invalid\n"));
+		return -1;
+	}
+
+	m_slots = new QueuedPacket[capacity]();
+	m_capacity = capacity;
+	m_head = 0;
+	m_count = 0;
+
+	for (int32_t i = 0; i < m_capacity; i++)
+	{
+		m_slots[i].pkt = av_packet_alloc();
+		if (!m_slots[i].pkt)
+		{
+			TRACE(_T("cannot allocate queued packet\n"));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int32_t PacketQueue::push(const AVPacket* pkt, std::chrono::steady_clock::time_point capture_time)
+{
+	if (m_count == m_capacity && grow() < 0)
+	{
+		return -1;
+	}
+
+	QueuedPacket& slot = m_slots[(m_head + m_count) % m_capacity];
+	if (av_packet_ref(slot.pkt, pkt) < 0)
+	{
+		TRACE(_T("cannot reference queued packet\n"));
+		return -1;
+	}
+	slot.capture_time = capture_time;
+	m_count++;
+
+	return 0;
+}
+
+void PacketQueue::pop_front(AVPacket* pkt)
+{
+	QueuedPacket& slot = m_slots[m_head];
+
+	if (pkt)
+	{
+		av_packet_unref(pkt);
+		av_packet_move_ref(pkt, slot.pkt);
+	}
+	else
+	{
+		av_packet_unref(slot.pkt);
+	}
+
+	m_head = (m_head + 1) % m_capacity;
+	m_count--;
+}
+
+void PacketQueue::clear()
+{
+	while (m_count > 0)
+	{
+		pop_front(nullptr);
+	}
+}
+
+int32_t PacketQueue::grow()
+{
+	int32_t capacity = m_capacity * 2;
+	QueuedPacket* slots = new QueuedPacket[capacity]();
+
+	// slots move over in queue order so the ring restarts at 0, only the added slots get new packets
+	for (int32_t i = 0; i < m_capacity; i++)
+	{
+		slots[i] = m_slots[(m_head + i) % m_capacity];
+	}
+	for (int32_t i = m_capacity; i < capacity; i++)
+	{
+		slots[i].pkt = av_packet_alloc();
+		if (!slots[i].pkt)
+		{
+			for (int32_t j = m_capacity; j < i; j++)
+			{
+				av_packet_free(&slots[j].pkt);
+			}
+			delete[] slots;
+			TRACE(_T("cannot allocate queued packet\n"));
+			return -1;
+		}
+	}
+
+	delete[] m_slots;
+	m_slots = slots;
+	m_capacity = capacity;
+	m_head = 0;
+
+	return 0;
+}
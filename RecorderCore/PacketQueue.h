@@ -0,0 +1,45 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <chrono>
+
+struct QueuedPacket
+{
+	AVPacket* pkt;
+	std::chrono::steady_clock::time_point capture_time;
+};
+
+// ring of packet references, every slot keeps its AVPacket so a steady stream of packets reuses them
+// instead of allocating one per packet, the owner does the locking
+class PacketQueue
+{
+public:
+	PacketQueue();
+	~PacketQueue();
+
+	int32_t initialize(int32_t capacity);
+
+	// references the payload of pkt, no copy, the ring doubles when it is full
+	int32_t push(const AVPacket* pkt, std::chrono::steady_clock::time_point capture_time);
+	// index 0 is the oldest packet
+	QueuedPacket& at(int32_t index) { return m_slots[(m_head + index) % m_capacity]; }
+	QueuedPacket& front() { return m_slots[m_head]; }
+	// the oldest reference moves into pkt, or is dropped when pkt is nullptr
+	void pop_front(AVPacket* pkt);
+	void clear();
+
+	int32_t size() { return m_count; }
+	bool empty() { return m_count == 0; }
+	int32_t get_capacity() { return m_capacity; }
+
+private:
+	int32_t grow();
+
+	QueuedPacket* m_slots;
+	int32_t m_capacity;
+	int32_t m_head;
+	int32_t m_count;
+};
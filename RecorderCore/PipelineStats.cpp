@@ -0,0 +1,175 @@
+#include "pch.h"
+#include "PipelineStats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+PipelineStats::PipelineStats()
+{
+	reset();
+}
+
+const char* PipelineStats::get_stage_name(PipelineStage stage)
+{
+	switch (stage)
+	{
+	case PIPELINE_STAGE_ACQUIRE:
+		return "acquire";
+	case PIPELINE_STAGE_COPY:
+		return "copy";
+	case PIPELINE_STAGE_CONVERT:
+		return "convert";
+	case PIPELINE_STAGE_ENCODE:
+		return "encode";
+	case PIPELINE_STAGE_MUX:
+		return "mux";
+	case PIPELINE_STAGE_WRITE:
+		return "write";
+	default:
+		break;
+	}
+
+	return "unknown stage";
+}
+
+int64_t PipelineStats::get_process_cpu_us()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+
+	// 100 ns units
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (int64_t)((k.QuadPart + u.QuadPart) / 10);
+#else
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 * 1000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+void PipelineStats::reset()
+{
+	for (int32_t i = 0; i < PIPELINE_STAGE_COUNT; i++)
+	{
+		m_stages[i].reset();
+	}
+	m_glass_to_packet.reset();
+
+	m_encoded_frames = 0;
+	m_encoded_bytes = 0;
+	m_keyframe_packets = 0;
+	for (int32_t i = 0; i < PACKET_SIZE_BUCKETS; i++)
+	{
+		m_packet_size_histogram[i] = 0;
+	}
+	m_bytes_written = 0;
+	m_frame_queue_depth = 0;
+	m_max_frame_queue_depth = 0;
+	m_write_queue_depth = 0;
+	m_max_write_queue_depth = 0;
+}
+
+void PipelineStats::add_encoded_frame(int64_t bytes, bool keyframe)
+{
+	int32_t bucket = 0;
+	while ((bytes >> (bucket + 1)) > 0 && bucket < PACKET_SIZE_BUCKETS - 1) bucket++;
+
+	m_encoded_frames++;
+	m_encoded_bytes += bytes;
+	m_packet_size_histogram[bucket]++;
+	if (keyframe) m_keyframe_packets++;
+}
+
+void PipelineStats::set_frame_queue_depth(int32_t depth)
+{
+	m_frame_queue_depth = depth;
+	if (depth > m_max_frame_queue_depth) m_max_frame_queue_depth = depth;
+}
+
+void PipelineStats::set_write_queue_depth(int32_t depth)
+{
+	m_write_queue_depth = depth;
+	if (depth > m_max_write_queue_depth) m_max_write_queue_depth = depth;
+}
+
+void PipelineStats::get_stage_stats(LatencyHistogram& histogram, StageStats* stats)
+{
+	stats->count = histogram.get_count();
+	stats->mean_us = histogram.get_mean();
+	stats->p50_us = histogram.get_percentile(50);
+	stats->p90_us = histogram.get_percentile(90);
+	stats->p99_us = histogram.get_percentile(99);
+	stats->max_us = histogram.get_max();
+}
+
+void PipelineStats::get_snapshot(PipelineSnapshot* snapshot)
+{
+	for (int32_t i = 0; i < PIPELINE_STAGE_COUNT; i++)
+	{
+		get_stage_stats(m_stages[i], &snapshot->stages[i]);
+	}
+	get_stage_stats(m_glass_to_packet, &snapshot->glass_to_packet);
+
+	snapshot->encoded_frames = m_encoded_frames;
+	snapshot->encoded_bytes = m_encoded_bytes;
+	snapshot->keyframe_packets = m_keyframe_packets;
+	for (int32_t i = 0; i < PACKET_SIZE_BUCKETS; i++)
+	{
+		snapshot->packet_size_histogram[i] = m_packet_size_histogram[i];
+	}
+	snapshot->bytes_written = m_bytes_written;
+	snapshot->frame_queue_depth = m_frame_queue_depth;
+	snapshot->max_frame_queue_depth = m_max_frame_queue_depth;
+	snapshot->write_queue_depth = m_write_queue_depth;
+	snapshot->max_write_queue_depth = m_max_write_queue_depth;
+}
+
+std::string PipelineStats::format_json(const PipelineSnapshot& snapshot)
+{
+	char buffer[512];
+	std::string json;
+
+	snprintf(buffer, sizeof(buffer),
+		"{\"running\":%s,\"elapsed_us\":%lld,\"fps\":%.2f,\"captured_frames\":%lld,\"unchanged_frames\":%lld,"
+		"\"dropped_frames\":%lld,\"duplicated_frames\":%lld,\"encoded_frames\":%lld,\"encoded_bytes\":%lld,\"keyframe_packets\":%lld,"
+		"\"bytes_written\":%lld,\"frame_queue_depth\":%d,\"max_frame_queue_depth\":%d,\"write_queue_depth\":%d,\"max_write_queue_depth\":%d,"
+		"\"packet_size_histogram\":[",
+		snapshot.running ? "true" : "false", (long long)snapshot.elapsed_us, snapshot.fps, (long long)snapshot.captured_frames,
+		(long long)snapshot.unchanged_frames, (long long)snapshot.dropped_frames, (long long)snapshot.duplicated_frames,
+		(long long)snapshot.encoded_frames, (long long)snapshot.encoded_bytes, (long long)snapshot.keyframe_packets,
+		(long long)snapshot.bytes_written, snapshot.frame_queue_depth, snapshot.max_frame_queue_depth, snapshot.write_queue_depth,
+		snapshot.max_write_queue_depth);
+	json = buffer;
+
+	for (int32_t i = 0; i < PACKET_SIZE_BUCKETS; i++)
+	{
+		snprintf(buffer, sizeof(buffer), "%s%lld", i > 0 ? "," : "", (long long)snapshot.packet_size_histogram[i]);
+		json += buffer;
+	}
+	json += "],\"stages\":{";
+
+	for (int32_t i = 0; i < PIPELINE_STAGE_COUNT; i++)
+	{
+		const StageStats& stage = snapshot.stages[i];
+		snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"count\":%lld,\"mean_us\":%lld,\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}",
+			i > 0 ? "," : "", get_stage_name((PipelineStage)i), (long long)stage.count, (long long)stage.mean_us,
+			(long long)stage.p50_us, (long long)stage.p90_us, (long long)stage.p99_us, (long long)stage.max_us);
+		json += buffer;
+	}
+
+	const StageStats& glass = snapshot.glass_to_packet;
+	snprintf(buffer, sizeof(buffer), "},\"glass_to_packet\":{\"count\":%lld,\"mean_us\":%lld,\"p50_us\":%lld,\"p90_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}}",
+		(long long)glass.count, (long long)glass.mean_us, (long long)glass.p50_us, (long long)glass.p90_us, (long long)glass.p99_us, (long long)glass.max_us);
+	json += buffer;
+
+	return json;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "LatencyHistogram.h"
+#include "Tracer.h"
+
+// bucket i of the packet size histogram counts packets of [2^i, 2^(i+1)) bytes
+#define PACKET_SIZE_BUCKETS 32
+
+// timed steps a frame goes through, in pipeline order
+enum PipelineStage
+{
+	PIPELINE_STAGE_ACQUIRE,		// capture source reading a new picture back from the display
+	PIPELINE_STAGE_COPY,		// latest picture copied into a frame queue slot on the frame tick
+	PIPELINE_STAGE_CONVERT,		// BGRA to YUV conversion and scaling
+	PIPELINE_STAGE_ENCODE,		// encoder submit and packet retrieval, muxing excluded
+	PIPELINE_STAGE_MUX,			// container write of one packet, includes waits for a free write buffer
+	PIPELINE_STAGE_WRITE,		// one write buffer going to disk on the writer thread
+	PIPELINE_STAGE_COUNT,
+};
+
+struct StageStats
+{
+	int64_t count;
+	int64_t mean_us;
+	int64_t p50_us;
+	int64_t p90_us;
+	int64_t p99_us;
+	int64_t max_us;
+};
+
+// point in time copy of the pipeline counters, totals are since record start
+struct PipelineSnapshot
+{
+	bool running;
+	int64_t elapsed_us;
+	double fps;						// ticks served per second, unchanged ticks included
+	int64_t captured_frames;
+	int64_t unchanged_frames;
+	int64_t dropped_frames;
+	int64_t duplicated_frames;
+	int64_t encoded_frames;
+	int64_t encoded_bytes;
+	int64_t keyframe_packets;
+	int64_t packet_size_histogram[PACKET_SIZE_BUCKETS];
+	int64_t bytes_written;
+	int32_t frame_queue_depth;
+	int32_t max_frame_queue_depth;
+	int32_t write_queue_depth;
+	int32_t max_write_queue_depth;
+	StageStats stages[PIPELINE_STAGE_COUNT];
+	StageStats glass_to_packet;		// new picture produced by the source to its encoded packet
+};
+
+// per stage timings and counters shared by every thread of one recorder, all updates are lock free
+class PipelineStats
+{
+public:
+	PipelineStats();
+
+	static const char* get_stage_name(PipelineStage stage);
+	static int64_t elapsed_us(std::chrono::steady_clock::time_point since)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+	}
+	// user plus kernel time of the whole process
+	static int64_t get_process_cpu_us();
+
+	void reset();
+
+	void add_stage_us(PipelineStage stage, int64_t us) { m_stages[stage].record(us); }
+	// stage from start until now, also placed on the timeline when tracing is enabled
+	void add_stage(PipelineStage stage, std::chrono::steady_clock::time_point start, int64_t frame = -1)
+	{
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		m_stages[stage].record(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+		if (Tracer::is_enabled()) Tracer::add_event(get_stage_name(stage), start, end, frame);
+	}
+	void add_encoded_frame(int64_t bytes, bool keyframe);
+	void add_glass_to_packet_us(int64_t us) { m_glass_to_packet.record(us); }
+	void add_bytes_written(int64_t bytes) { m_bytes_written += bytes; }
+	void set_frame_queue_depth(int32_t depth);
+	void set_write_queue_depth(int32_t depth);
+
+	// fills the stage and queue fields, the caller adds the counters it owns
+	void get_snapshot(PipelineSnapshot* snapshot);
+	// one line JSON object
+	static std::string format_json(const PipelineSnapshot& snapshot);
+
+private:
+	static void get_stage_stats(LatencyHistogram& histogram, StageStats* stats);
+
+	LatencyHistogram m_stages[PIPELINE_STAGE_COUNT];
+	LatencyHistogram m_glass_to_packet;
+	std::atomic<int64_t> m_encoded_frames;
+	std::atomic<int64_t> m_encoded_bytes;
+	std::atomic<int64_t> m_keyframe_packets;
+	std::atomic<int64_t> m_packet_size_histogram[PACKET_SIZE_BUCKETS];
+	std::atomic<int64_t> m_bytes_written;
+	std::atomic<int32_t> m_frame_queue_depth;
+	std::atomic<int32_t> m_max_frame_queue_depth;
+	std::atomic<int32_t> m_write_queue_depth;
+	std::atomic<int32_t> m_max_write_queue_depth;
+};
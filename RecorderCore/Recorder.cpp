@@ -0,0 +1,880 @@
+#include "pch.h"
+#include "Recorder.h"
+#include "SyntheticSource.h"
+
+#include <wchar.h>
+
+#ifdef _WIN32
+#include "Duplicator.h"
+#endif
+
+Recorder::Recorder()
+{
+	m_capture = nullptr;
+	m_encoder = nullptr;
+	m_frame_queue = nullptr;
+	m_record_running = false;
+	m_record_paused = false;
+	m_prepared = false;
+	m_keep_warm = true;
+
+	m_display = L"\\\\.\\DISPLAY1";
+	m_output_filename = "output.mp4";
+	m_output_width = 0;
+	m_output_height = 0;
+	m_fps = 30;
+	m_frame_policy = FRAME_POLICY_DUPLICATE_LAST;
+	m_queue_capacity = 3;
+	m_encoder_mode = ENCODER_MODE_LOW_LATENCY;
+	m_bitrate = 4 * 1000 * 1000;
+	m_rate_control = RATE_CONTROL_ABR;
+	m_crf = 23;
+	m_max_bitrate = 0;
+	m_roi = true;
+	m_keyframe_policy = KEYFRAME_POLICY_FIXED_GOP;
+	m_keyframe_interval = 0;
+	m_write_buffer_kb = DEFAULT_WRITE_BUFFER_SIZE / 1024;
+	m_write_buffer_count = DEFAULT_WRITE_BUFFER_COUNT;
+	m_preallocate_mb = 0;
+	m_segment_seconds = 0;
+	m_segment_megabytes = 0;
+	m_live_mux_delay_ms = 0;
+	m_live_pace_bitrate = 0;
+	m_playlist_segment_seconds = 2;
+	m_playlist_list_size = 0;
+	m_replay_seconds = 0;
+	m_replay_megabytes = 0;
+	m_stats_interval_ms = 1000;
+
+	m_captured_frames = 0;
+	m_duplicated_frames = 0;
+	m_late_frames = 0;
+	m_first_capture_us = -1;
+	m_first_encode_us = -1;
+	m_resume_latency_us = -1;
+	m_finalize_us = 0;
+	m_dropped_frames = 0;
+	m_unchanged_frames = 0;
+	m_pickup_latency_sum_us = 0;
+	m_pickup_count = 0;
+	m_max_pickup_latency_us = 0;
+	m_capture_wakeups = 0;
+	m_record_us = 0;
+	m_finalize_deadline_ms = 5000;
+	m_encode_delay_ms = 0;
+	m_pacer_wait = PACER_WAIT_SLEEP;
+}
+
+Recorder::~Recorder()
+{
+	m_keep_warm = false;
+	stop_record();
+
+	wait_prepared();
+	release_record();
+}
+
+int64_t Recorder::start_elapsed_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_start_request).count();
+}
+
+int64_t Recorder::elapsed_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_record_start).count();
+}
+
+void Recorder::record_thread()
+{
+	int64_t pts = 0;
+	int64_t last_pts = -1;
+	int64_t unchanged_pts = -1;
+	int64_t sequence = 0;
+	int64_t last_sequence = -1;
+	// an unchanged screen still gets a real frame this often, the encoder fills the ticks between
+	int64_t keepalive_ticks = m_fps / 2 > 1 ? m_fps / 2 : 1;
+	bool resumed = false;
+
+	Tracer::set_thread_name("record");
+	m_pacer.set_wait(m_pacer_wait);
+	m_pacer.start(m_fps, m_record_start);
+
+	while (m_record_running)
+	{
+		if (m_record_paused)
+		{
+			// the picture shown up to the pause ends the segment before it
+			if (unchanged_pts > last_pts && capture_frame(unchanged_pts, false))
+			{
+				last_pts = unchanged_pts;
+			}
+
+			// capture and encoder stay alive, only the frame feed stops
+			std::unique_lock<std::mutex> lock(m_pause_mutex);
+			m_pause_cond.wait(lock, [=]() { return !m_record_paused || !m_record_running; });
+
+			// continue the timeline right after the last frame, the output has no gap
+			m_pacer.resume(last_pts + 1);
+			resumed = true;
+			continue;
+		}
+
+		// timestamp is the tick of the record clock, intervals missed while capturing are skipped
+		pts = m_pacer.wait_next();
+		if (m_record_paused || !m_record_running)
+		{
+			continue;
+		}
+
+		// nothing new since the last copy, the encoder repeats the previous picture for this tick
+		sequence = m_capture->get_frame_sequence();
+		if (m_frame_policy == FRAME_POLICY_DUPLICATE_LAST && sequence == last_sequence &&
+			!resumed && pts - last_pts < keepalive_ticks)
+		{
+			unchanged_pts = pts;
+			m_unchanged_frames++;
+			continue;
+		}
+
+		bool new_picture = sequence != last_sequence && sequence > 0;
+		if (new_picture)
+		{
+			add_pickup_latency(now_steady_us() - m_capture->get_signal_us());
+		}
+
+		if (capture_frame(pts, new_picture))
+		{
+			last_sequence = sequence;
+		}
+		last_pts = pts;
+
+		if (resumed)
+		{
+			m_resume_latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - m_resume_request).count();
+			TRACE(_T("resume to first captured frame %lld us\n"), (long long)m_resume_latency_us.load());
+			resumed = false;
+		}
+	}
+
+	// the last unchanged ticks still belong to the recording, close them with a real frame
+	if (unchanged_pts > last_pts)
+	{
+		capture_frame(unchanged_pts, false);
+	}
+}
+
+bool Recorder::capture_frame(int64_t pts, bool new_picture)
+{
+	uint8_t* buffer = nullptr;
+	FrameInfo info;
+
+	buffer = m_frame_queue->begin_push();
+	if (!buffer)
+	{
+		return false;
+	}
+
+	info.pts = pts;
+	info.capture_us = elapsed_us();
+	// the source clock is absolute, its age at pickup moves it onto the record clock
+	info.present_us = new_picture ? info.capture_us - (now_steady_us() - m_capture->get_signal_us()) : -1;
+	info.region_count = -1;
+	info.cursor_visible = false;
+
+	// get current desktop raw image
+	std::chrono::steady_clock::time_point t_copy = std::chrono::steady_clock::now();
+	m_capture->get_frame_data(buffer, &info);
+	m_stats.add_stage(PIPELINE_STAGE_COPY, t_copy, pts);
+
+	m_frame_queue->end_push(info);
+	m_stats.set_frame_queue_depth(m_frame_queue->get_depth());
+	m_captured_frames++;
+	if (m_first_capture_us < 0) m_first_capture_us = start_elapsed_us();
+
+	return true;
+}
+
+int64_t Recorder::now_steady_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Recorder::add_pickup_latency(int64_t latency_us)
+{
+	if (latency_us < 0) latency_us = 0;
+
+	m_pickup_latency_sum_us += latency_us;
+	m_pickup_count++;
+	if (latency_us > m_max_pickup_latency_us) m_max_pickup_latency_us = latency_us;
+}
+
+int64_t Recorder::get_average_pickup_latency_us()
+{
+	int64_t count = m_pickup_count;
+
+	return count > 0 ? m_pickup_latency_sum_us / count : 0;
+}
+
+int64_t Recorder::get_dropped_frames()
+{
+	std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+	return m_frame_queue ? m_frame_queue->get_dropped_frames() : m_dropped_frames.load();
+}
+
+int64_t Recorder::get_capture_wakeups()
+{
+	std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+	return m_record_running && m_capture ? m_capture->get_wakeups() : m_capture_wakeups.load();
+}
+
+PipelineSnapshot Recorder::get_stats()
+{
+	PipelineSnapshot snapshot;
+
+	m_stats.get_snapshot(&snapshot);
+	snapshot.running = m_record_running;
+	snapshot.elapsed_us = m_record_running ? elapsed_us() : m_record_us.load();
+	snapshot.captured_frames = m_captured_frames;
+	snapshot.unchanged_frames = m_unchanged_frames;
+	snapshot.dropped_frames = get_dropped_frames();
+	snapshot.duplicated_frames = m_duplicated_frames;
+	snapshot.fps = snapshot.elapsed_us > 0 ?
+		(snapshot.captured_frames + snapshot.unchanged_frames) * 1000000.0 / snapshot.elapsed_us : 0.0;
+
+	return snapshot;
+}
+
+void Recorder::dump_stats()
+{
+	std::string json;
+	FILE* file = nullptr;
+
+	if (m_stats_filename.empty())
+	{
+		return;
+	}
+
+	json = PipelineStats::format_json(get_stats());
+
+	// reopened for every line so the file can be followed, rotated or deleted while recording
+	file = fopen(m_stats_filename.c_str(), "a");
+	if (!file)
+	{
+		TRACE(_T("cannot open stats file %s\n"), m_stats_filename.c_str());
+		return;
+	}
+
+	fprintf(file, "%s\n", json.c_str());
+	fclose(file);
+}
+
+void Recorder::stats_thread()
+{
+	std::unique_lock<std::mutex> lock(m_pause_mutex);
+
+	while (!m_pause_cond.wait_for(lock, std::chrono::milliseconds(m_stats_interval_ms), [=]() { return !m_record_running; }))
+	{
+		lock.unlock();
+		dump_stats();
+		lock.lock();
+	}
+}
+
+void Recorder::encode_thread(Encoder* encoder, FrameQueue* frame_queue)
+{
+	int64_t frame_us = (1 * 1000 * 1000) / m_fps;
+	int64_t last_pts = -1;
+	uint8_t* buffer = nullptr;
+	FrameInfo info;
+
+	Tracer::set_thread_name("encode");
+
+	for (;;)
+	{
+		buffer = frame_queue->pop(&info, 100);
+		if (!buffer)
+		{
+			// keep draining queued frames after stop is requested
+			if (frame_queue->is_closed()) break;
+			continue;
+		}
+		m_stats.set_frame_queue_depth(frame_queue->get_depth());
+
+		if (frame_queue->is_past_deadline())
+		{
+			TRACE(_T("finalize deadline passed, discarding queued frames\n"));
+			frame_queue->release();
+			break;
+		}
+
+		if (elapsed_us() - info.capture_us > frame_us)
+		{
+			m_late_frames++;
+		}
+
+		// fill skipped timestamps with the previous picture to keep a constant frame rate
+		if (m_frame_policy == FRAME_POLICY_DUPLICATE_LAST && last_pts >= 0)
+		{
+			while (last_pts + 1 < info.pts)
+			{
+				encoder->encode_duplicate(++last_pts);
+				m_duplicated_frames++;
+			}
+		}
+
+		if (m_encode_delay_ms > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_encode_delay_ms));
+		}
+
+		// encode frame
+		encoder->encode_frame(buffer, info);
+		last_pts = info.pts;
+		if (m_first_encode_us < 0) m_first_encode_us = start_elapsed_us();
+
+		frame_queue->release();
+	}
+}
+
+void Recorder::finalize_thread(Encoder* encoder, FrameQueue* frame_queue, std::thread encode,
+	std::thread previous, std::chrono::steady_clock::time_point deadline, FinalizeCallback callback)
+{
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+	int32_t ret = 0;
+
+	Tracer::set_thread_name("finalize");
+
+	// finalizations complete in stop order
+	if (previous.joinable())
+	{
+		previous.join();
+	}
+
+	if (encode.joinable())
+	{
+		TraceScope trace("drain");
+		encode.join();
+	}
+
+	{
+		TraceScope trace("flush");
+		ret = encoder->output_close(deadline);
+		if (encoder->is_flush_truncated()) ret = -1;
+	}
+
+	m_finalize_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count();
+	TRACE(_T("finalize %lld us, encoder flush %lld us\n"), (long long)m_finalize_us.load(), (long long)encoder->get_flush_us());
+
+	// final line includes the flushed packets and the last disk writes
+	dump_stats();
+
+	if (!m_trace_output.empty())
+	{
+		Tracer::stop(m_trace_output.c_str());
+		m_trace_output.clear();
+	}
+
+	delete encoder;
+	delete frame_queue;
+
+	if (callback)
+	{
+		callback(ret, m_finalize_us);
+	}
+}
+
+void Recorder::request_keyframe()
+{
+	std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+	if (m_record_running && m_encoder)
+	{
+		m_encoder->request_keyframe();
+	}
+}
+
+void Recorder::add_marker(const char* title)
+{
+	std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+	if (m_record_running && m_encoder)
+	{
+		m_encoder->add_marker(title);
+	}
+}
+
+int32_t Recorder::save_replay(const char* filename, ReplaySaveCallback callback)
+{
+	std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+	if (!m_record_running || !m_encoder)
+	{
+		return -1;
+	}
+
+	return m_encoder->save_replay(filename, callback);
+}
+
+bool ArmedSettings::operator==(const ArmedSettings& other) const
+{
+	return display == other.display && output_width == other.output_width && output_height == other.output_height &&
+		fps == other.fps && frame_policy == other.frame_policy && queue_capacity == other.queue_capacity &&
+		encoder_mode == other.encoder_mode && bitrate == other.bitrate && rate_control == other.rate_control &&
+		crf == other.crf && max_bitrate == other.max_bitrate && roi == other.roi &&
+		keyframe_policy == other.keyframe_policy && keyframe_interval == other.keyframe_interval &&
+		write_buffer_kb == other.write_buffer_kb && write_buffer_count == other.write_buffer_count &&
+		preallocate_mb == other.preallocate_mb && segment_seconds == other.segment_seconds &&
+		segment_megabytes == other.segment_megabytes && replay_seconds == other.replay_seconds &&
+		replay_megabytes == other.replay_megabytes;
+}
+
+ArmedSettings Recorder::get_settings()
+{
+	ArmedSettings settings;
+
+	settings.display = m_display;
+	settings.output_width = m_output_width;
+	settings.output_height = m_output_height;
+	settings.fps = m_fps;
+	settings.frame_policy = m_frame_policy;
+	settings.queue_capacity = m_queue_capacity;
+	settings.encoder_mode = m_encoder_mode;
+	settings.bitrate = m_bitrate;
+	settings.rate_control = m_rate_control;
+	settings.crf = m_crf;
+	settings.max_bitrate = m_max_bitrate;
+	settings.roi = m_roi;
+	settings.keyframe_policy = m_keyframe_policy;
+	settings.keyframe_interval = m_keyframe_interval;
+	settings.write_buffer_kb = m_write_buffer_kb;
+	settings.write_buffer_count = m_write_buffer_count;
+	settings.preallocate_mb = m_preallocate_mb;
+	settings.segment_seconds = m_segment_seconds;
+	settings.segment_megabytes = m_segment_megabytes;
+	settings.replay_seconds = m_replay_seconds;
+	settings.replay_megabytes = m_replay_megabytes;
+
+	return settings;
+}
+
+int32_t Recorder::prepare_record()
+{
+	return arm_record(get_settings());
+}
+
+int32_t Recorder::arm_record(const ArmedSettings& settings)
+{
+	int32_t ret = 0;
+	bool prepared = false;
+	CaptureSource* capture = nullptr;
+	FrameQueue* frame_queue = nullptr;
+	Encoder* encoder = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_armed_mutex);
+
+		// a running recording keeps its instances, armed ones built from older settings are thrown away
+		if (m_prepared && (m_record_running || settings == m_armed))
+		{
+			return 0;
+		}
+		prepared = m_prepared;
+	}
+	if (prepared)
+	{
+		TRACE(_T("settings changed since arming, arming again\n"));
+		release_record();
+	}
+
+	// built from the copy only, the caller may change the settings meanwhile
+	do
+	{
+		capture = create_capture_source(settings);
+		if (!capture)
+		{
+			ret = -1;
+			break;
+		}
+		capture->set_stats(&m_stats);
+
+		frame_queue = new FrameQueue();
+		if (!frame_queue)
+		{
+			ret = -1;
+			break;
+		}
+
+		ret = frame_queue->initialize(settings.queue_capacity, capture->get_frame_buffer_length(), settings.frame_policy);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		// create and initialize encoder, the packet callback is set by start_record
+		encoder = new Encoder();
+		if (!encoder)
+		{
+			ret = -1;
+			break;
+		}
+
+		encoder->set_width(capture->get_width());
+		encoder->set_height(capture->get_height());
+		encoder->set_bytepixel(capture->get_bytepixel());
+		encoder->set_output_size(settings.output_width, settings.output_height);
+		encoder->set_fps(settings.fps);
+		encoder->set_bitrate(settings.bitrate);
+		encoder->set_mode(settings.encoder_mode);
+		encoder->set_rate_control(settings.rate_control);
+		encoder->set_crf(settings.crf);
+		encoder->set_max_bitrate(settings.max_bitrate);
+		encoder->set_roi(settings.roi);
+		encoder->set_keyframe_policy(settings.keyframe_policy);
+		encoder->set_keyframe_interval(settings.keyframe_interval);
+		encoder->set_write_buffer(settings.write_buffer_kb * 1024, settings.write_buffer_count);
+		encoder->set_preallocate((int64_t)settings.preallocate_mb * 1024 * 1024);
+		encoder->set_segment(settings.segment_seconds, (int64_t)settings.segment_megabytes * 1024 * 1024);
+		encoder->set_replay(settings.replay_seconds, (int64_t)settings.replay_megabytes * 1024 * 1024);
+		encoder->set_stats(&m_stats);
+
+		ret = encoder->initialize();
+		if (ret < 0)
+		{
+			break;
+		}
+	} while (false);
+
+	if (ret < 0)
+	{
+		delete encoder;
+		if (capture)
+		{
+			capture->stop_capture();
+			delete capture;
+		}
+		delete frame_queue;
+		return -1;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_armed_mutex);
+		m_capture = capture;
+		m_frame_queue = frame_queue;
+		m_encoder = encoder;
+		m_armed = settings;
+		m_prepared = true;
+	}
+
+	return 0;
+}
+
+CaptureSource* Recorder::create_capture_source(const ArmedSettings& settings)
+{
+	// synthetic[:WxH[@mean_ms]][,scroll][,stamp], an update every frame interval on average unless given
+	if (settings.display.compare(0, 9, L"synthetic") == 0)
+	{
+		int32_t width = 1920;
+		int32_t height = 1080;
+		int32_t mean_interval_ms = 1000 / settings.fps > 0 ? 1000 / settings.fps : 1;
+		SyntheticSource* synthetic = new SyntheticSource();
+
+		swscanf(settings.display.c_str(), L"synthetic:%dx%d@%d", &width, &height, &mean_interval_ms);
+		if (synthetic->initialize(width, height, mean_interval_ms) < 0)
+		{
+			delete synthetic;
+			return nullptr;
+		}
+		if (settings.display.find(L",scroll") != std::wstring::npos)
+		{
+			synthetic->set_content(SYNTHETIC_CONTENT_SCROLL);
+		}
+		if (settings.display.find(L",stamp") != std::wstring::npos)
+		{
+			synthetic->set_stamp(true);
+		}
+
+		return synthetic;
+	}
+
+#ifdef _WIN32
+	Duplicator* duplicator = new Duplicator();
+
+	HRESULT hr = duplicator->initialize(settings.display.c_str(), settings.fps);
+	if (FAILED(hr))
+	{
+		delete duplicator;
+		return nullptr;
+	}
+
+	return duplicator;
+#else
+	TRACE(_T("no capture source on this platform\n"));
+	return nullptr;
+#endif
+}
+
+void Recorder::prepare_record_async()
+{
+	wait_prepared();
+
+	// taken on the calling thread, setters may run while the copy is armed
+	ArmedSettings settings = get_settings();
+	m_prepare_thread = std::move(std::thread([=]() {
+		arm_record(settings);
+		}));
+}
+
+void Recorder::wait_prepared()
+{
+	if (m_prepare_thread.joinable())
+	{
+		m_prepare_thread.join();
+	}
+}
+
+void Recorder::release_record()
+{
+	Encoder* encoder = nullptr;
+	CaptureSource* capture = nullptr;
+	FrameQueue* frame_queue = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_armed_mutex);
+		encoder = m_encoder;
+		capture = m_capture;
+		frame_queue = m_frame_queue;
+		m_encoder = nullptr;
+		m_capture = nullptr;
+		m_frame_queue = nullptr;
+		m_prepared = false;
+	}
+
+	delete encoder;
+
+	// stop and delete capture source
+	if (capture)
+	{
+		capture->stop_capture();
+		delete capture;
+	}
+
+	delete frame_queue;
+}
+
+void Recorder::pause_record()
+{
+	std::lock_guard<std::mutex> lock(m_pause_mutex);
+
+	if (m_record_running)
+	{
+		m_record_paused = true;
+	}
+}
+
+void Recorder::resume_record()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_pause_mutex);
+
+		if (!m_record_running || !m_record_paused)
+		{
+			return;
+		}
+
+		m_resume_request = std::chrono::steady_clock::now();
+		m_record_paused = false;
+	}
+
+	m_pause_cond.notify_all();
+}
+
+int32_t Recorder::start_record()
+{
+	int32_t ret = 0;
+
+	if (m_record_running)
+	{
+		return 0;
+	}
+
+	m_start_request = std::chrono::steady_clock::now();
+	m_first_capture_us = -1;
+	m_first_encode_us = -1;
+
+	// the previous recording may still be writing the same output file
+	wait_finalized();
+	m_stats.reset();
+
+	// use the instances armed in the background, or arm them now
+	wait_prepared();
+	ret = prepare_record();
+	if (ret < 0)
+	{
+		return -1;
+	}
+	// not part of the armed settings, the encode thread has not started yet
+	m_encoder->set_packet_callback(m_packet_callback);
+
+	// in replay mode nothing is written until save_replay, without a filename packets only go to the callback
+	if (m_replay_seconds == 0 && !m_output_filename.empty())
+	{
+		ret = m_encoder->output_open(m_output_filename.c_str());
+		if (ret < 0)
+		{
+			release_record();
+			return -1;
+		}
+	}
+
+	// a failed live output does not stop the recording
+	if (!m_live_url.empty() && m_encoder->live_open(m_live_url.c_str(), m_live_mux_delay_ms, m_live_pace_bitrate) < 0)
+	{
+		TRACE(_T("live output disabled\n"));
+	}
+
+	if (!m_playlist.empty() && m_encoder->playlist_open(m_playlist.c_str(), m_playlist_segment_seconds, m_playlist_list_size) < 0)
+	{
+		TRACE(_T("playlist output disabled\n"));
+	}
+
+	// written by the finalize thread of this recording
+	m_trace_output = m_trace_filename;
+	if (!m_trace_output.empty())
+	{
+		Tracer::start();
+	}
+
+	m_capture->start_capture();
+
+	m_captured_frames = 0;
+	m_duplicated_frames = 0;
+	m_late_frames = 0;
+	m_unchanged_frames = 0;
+	m_pickup_latency_sum_us = 0;
+	m_pickup_count = 0;
+	m_max_pickup_latency_us = 0;
+	m_capture_wakeups = 0;
+	m_record_start = std::chrono::steady_clock::now();
+	m_encoder->set_clock_origin(m_record_start);
+	m_record_paused = false;
+	m_record_running = true;
+
+	// start encode and record thread
+	Encoder* encoder = m_encoder;
+	FrameQueue* frame_queue = m_frame_queue;
+	m_encode_thread = std::move(std::thread([=]() {
+		encode_thread(encoder, frame_queue);
+		}));
+
+	m_record_thread = std::move(std::thread([=]() {
+		record_thread();
+		}));
+
+	if (!m_stats_filename.empty() && m_stats_interval_ms > 0)
+	{
+		m_stats_thread = std::move(std::thread([=]() {
+			stats_thread();
+			}));
+	}
+
+	return 0;
+}
+
+void Recorder::stop_record()
+{
+	stop_record_async(nullptr);
+	wait_finalized();
+}
+
+void Recorder::stop_record_async(FinalizeCallback callback)
+{
+	CaptureSource* capture = nullptr;
+	Encoder* encoder = nullptr;
+	FrameQueue* frame_queue = nullptr;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+	if (!m_record_running)
+	{
+		return;
+	}
+
+	{
+		// wake a paused record thread
+		std::lock_guard<std::mutex> lock(m_pause_mutex);
+		m_record_running = false;
+	}
+	m_pause_cond.notify_all();
+
+	// capture stops right away
+	if (m_record_thread.joinable())
+	{
+		m_record_thread.join();
+	}
+	m_record_us = elapsed_us();
+
+	if (m_stats_thread.joinable())
+	{
+		m_stats_thread.join();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_armed_mutex);
+		capture = m_capture;
+		m_capture = nullptr;
+	}
+	capture->stop_capture();
+	m_capture_wakeups = capture->get_wakeups();
+	delete capture;
+
+	TRACE(_T("captured %lld, dropped %lld, duplicated %lld, late %lld frames\n"),
+		(long long)get_captured_frames(), (long long)get_dropped_frames(), (long long)get_duplicated_frames(), (long long)get_late_frames());
+	TRACE(_T("start to first captured frame %lld us, first encoded frame %lld us\n"),
+		(long long)m_first_capture_us.load(), (long long)m_first_encode_us.load());
+	TRACE(_T("unchanged %lld frames, new frame pickup avg %lld max %lld us, %lld capture wakeups\n"),
+		(long long)get_unchanged_frames(), (long long)get_average_pickup_latency_us(), (long long)get_max_pickup_latency_us(),
+		(long long)get_capture_wakeups());
+	TRACE(_T("%s pacing : %lld ticks, %lld skipped, error p50 %lld p99 %lld max %lld us\n"), Pacer::get_wait_name(m_pacer_wait),
+		(long long)m_pacer.get_ticks(), (long long)m_pacer.get_skipped_ticks(), (long long)m_pacer.get_error_percentile_us(50),
+		(long long)m_pacer.get_error_percentile_us(99), (long long)m_pacer.get_max_error_us());
+
+	// encode thread drains the queue and the encoder is flushed in the background
+	if (m_finalize_deadline_ms > 0)
+	{
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_finalize_deadline_ms);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_armed_mutex);
+		m_dropped_frames = m_frame_queue->get_dropped_frames();
+		encoder = m_encoder;
+		frame_queue = m_frame_queue;
+		m_encoder = nullptr;
+		m_frame_queue = nullptr;
+		m_prepared = false;
+	}
+
+	frame_queue->close(deadline);
+
+	m_finalize_thread = std::move(std::thread(&Recorder::finalize_thread, this, encoder, frame_queue,
+		std::move(m_encode_thread), std::move(m_finalize_thread), deadline, callback));
+
+	// arm the next recording right away
+	if (m_keep_warm)
+	{
+		prepare_record_async();
+	}
+}
+
+void Recorder::wait_finalized()
+{
+	if (m_finalize_thread.joinable())
+	{
+		m_finalize_thread.join();
+	}
+}
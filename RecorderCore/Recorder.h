@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "CaptureSource.h"
+#include "Encoder.h"
+#include "FrameQueue.h"
+#include "Pacer.h"
+#include "PipelineStats.h"
+
+// called from the finalize thread once the output is closed, result < 0 when the flush was truncated
+typedef std::function<void(int32_t result, int64_t finalize_us)> FinalizeCallback;
+
+// settings the capture source, frame queue and encoder are built from, the ones an armed recorder is bound to
+struct ArmedSettings
+{
+	std::wstring display;
+	int32_t output_width;
+	int32_t output_height;
+	int32_t fps;
+	FramePolicy frame_policy;
+	int32_t queue_capacity;
+	EncoderMode encoder_mode;
+	int32_t bitrate;
+	RateControl rate_control;
+	int32_t crf;
+	int32_t max_bitrate;
+	bool roi;
+	KeyframePolicy keyframe_policy;
+	int32_t keyframe_interval;
+	int32_t write_buffer_kb;
+	int32_t write_buffer_count;
+	int32_t preallocate_mb;
+	int32_t segment_seconds;
+	int32_t segment_megabytes;
+	int32_t replay_seconds;
+	int32_t replay_megabytes;
+
+	bool operator==(const ArmedSettings& other) const;
+	bool operator!=(const ArmedSettings& other) const { return !(*this == other); }
+};
+
+class Recorder
+{
+public:
+	Recorder();
+	~Recorder();
+
+	// display device name such as \\.\DISPLAY1, or synthetic[:WxH[@mean_ms]][,scroll][,stamp] for a generated source with
+	// irregular updates of a moving block or the whole picture, optionally stamped with a readable FrameStamp,
+	// output file and encoded size, 0 keeps the display size
+	void set_display(const wchar_t* display) { m_display = display; }
+	// an empty filename records without a file, for callers taking the packets from the packet callback
+	void set_output(const char* filename) { m_output_filename = filename ? filename : ""; }
+	void set_output_size(int32_t width, int32_t height) { m_output_width = width; m_output_height = height; }
+	void set_fps(int32_t fps) { m_fps = fps; }
+	// precise pacing trades a short spin before each frame for sub-millisecond tick accuracy
+	void set_pacer_wait(PacerWait wait) { m_pacer_wait = wait; }
+	void set_frame_policy(FramePolicy policy) { m_frame_policy = policy; }
+	void set_queue_capacity(int32_t capacity) { m_queue_capacity = capacity; }
+	void set_encoder_mode(EncoderMode mode) { m_encoder_mode = mode; }
+	void set_bitrate(int32_t bitrate) { m_bitrate = bitrate; }
+	void set_rate_control(RateControl rate_control) { m_rate_control = rate_control; }
+	void set_crf(int32_t crf) { m_crf = crf; }
+	void set_max_bitrate(int32_t max_bitrate) { m_max_bitrate = max_bitrate; }
+	void set_roi(bool roi) { m_roi = roi; }
+	void set_keyframe_policy(KeyframePolicy policy) { m_keyframe_policy = policy; }
+	void set_keyframe_interval(int32_t frames) { m_keyframe_interval = frames; }
+	// output file is written by a background thread through count buffers of kilobytes, 0 for plain avio
+	void set_write_buffer(int32_t kilobytes, int32_t count) { m_write_buffer_kb = kilobytes; m_write_buffer_count = count; }
+	void set_preallocate(int32_t megabytes) { m_preallocate_mb = megabytes; }
+	// split the recording into timestamped files every seconds or megabytes at a keyframe, 0 to disable either limit
+	void set_segment(int32_t seconds, int32_t megabytes) { m_segment_seconds = seconds; m_segment_megabytes = megabytes; }
+	// also stream MPEG-TS to udp://host:port or tcp://host:port?listen, empty url to disable
+	void set_live_output(const char* url, int32_t mux_delay_ms, int32_t pace_bitrate) { m_live_url = url ? url : ""; m_live_mux_delay_ms = mux_delay_ms; m_live_pace_bitrate = pace_bitrate; }
+	// browser playback while recording : fMP4 segments with an .m3u8 (HLS) or .mpd (DASH) playlist, empty to disable
+	void set_playlist_output(const char* playlist, int32_t segment_seconds, int32_t list_size) { m_playlist = playlist ? playlist : ""; m_playlist_segment_seconds = segment_seconds; m_playlist_list_size = list_size; }
+	// keep only the last seconds in memory, bounded by max_megabytes unless 0, instead of writing output.mp4
+	void set_replay(int32_t seconds, int32_t max_megabytes) { m_replay_seconds = seconds; m_replay_megabytes = max_megabytes; }
+	// encoded packets in 1/fps time base, called on the encode thread so it must not block
+	void set_packet_callback(PacketCallback callback) { m_packet_callback = callback; }
+
+	int64_t get_captured_frames() { return m_captured_frames; }
+	int64_t get_dropped_frames();
+	int64_t get_duplicated_frames() { return m_duplicated_frames; }
+	int64_t get_late_frames() { return m_late_frames; }
+	// ticks where the source had nothing new and no frame was copied
+	int64_t get_unchanged_frames() { return m_unchanged_frames; }
+	// new frame signalled by the source to its pickup on a frame tick
+	int64_t get_average_pickup_latency_us();
+	int64_t get_max_pickup_latency_us() { return m_max_pickup_latency_us; }
+	int64_t get_capture_wakeups();
+	int64_t get_first_capture_us() { return m_first_capture_us; }
+	int64_t get_first_encode_us() { return m_first_encode_us; }
+	int64_t get_resume_latency_us() { return m_resume_latency_us; }
+	int64_t get_finalize_us() { return m_finalize_us; }
+	int32_t get_fps() { return m_fps; }
+	bool is_running() { return m_record_running; }
+	// distance of capture ticks from their deadlines, valid during and after a recording
+	int64_t get_tick_error_us(double percentile) { return m_pacer.get_error_percentile_us(percentile); }
+	int64_t get_max_tick_error_us() { return m_pacer.get_max_error_us(); }
+	// per stage timings, counters and queue depths of the current or last recording
+	PipelineSnapshot get_stats();
+	// appends a JSON line with get_stats every interval_ms while recording and once more after finalizing,
+	// empty filename to disable
+	void set_stats_dump(const char* filename, int32_t interval_ms) { m_stats_filename = filename ? filename : ""; m_stats_interval_ms = interval_ms; }
+	// Chrome trace event timeline of every pipeline thread, written once the output is finalized, empty to disable.
+	// The tracer is process wide so only one recorder should trace at a time.
+	void set_trace_output(const char* filename) { m_trace_filename = filename ? filename : ""; }
+
+	// time allowed for draining and flushing after stop, 0 for no limit
+	void set_finalize_deadline(int32_t ms) { m_finalize_deadline_ms = ms; }
+	// artificial cost added to every encoded frame, stress runs use it to overrun the frame queue
+	void set_encode_delay(int32_t ms) { m_encode_delay_ms = ms; }
+
+	// capture and encoder are armed ahead of start_record and re-armed after each stop,
+	// arming again with the current settings when any of them changed in between
+	void set_keep_warm(bool keep_warm) { m_keep_warm = keep_warm; }
+	int32_t prepare_record();
+	// arms a copy of the settings taken by this call, setters and getters stay usable while it runs
+	void prepare_record_async();
+
+	void request_keyframe();
+	void add_marker(const char* title);
+	int32_t save_replay(const char* filename, ReplaySaveCallback callback);
+
+	void record_thread();
+	void encode_thread(Encoder* encoder, FrameQueue* frame_queue);
+	void stats_thread();
+	void finalize_thread(Encoder* encoder, FrameQueue* frame_queue, std::thread encode,
+		std::thread previous, std::chrono::steady_clock::time_point deadline, FinalizeCallback callback);
+	int32_t start_record();
+	void stop_record();
+	// capture stops immediately, draining and closing the output continue in the background
+	void stop_record_async(FinalizeCallback callback);
+	void wait_finalized();
+	// keeps capture, encoder and output open, the resumed timeline continues without a gap
+	void pause_record();
+	void resume_record();
+
+private:
+	void wait_prepared();
+	ArmedSettings get_settings();
+	// builds the instances from settings alone, a copy taken on the controlling thread
+	int32_t arm_record(const ArmedSettings& settings);
+	void release_record();
+	int64_t elapsed_us();
+	int64_t start_elapsed_us();
+	CaptureSource* create_capture_source(const ArmedSettings& settings);
+	// new_picture is false when the source has nothing newer than the previous capture
+	bool capture_frame(int64_t pts, bool new_picture);
+	int64_t now_steady_us();
+	void add_pickup_latency(int64_t latency_us);
+	void dump_stats();
+
+	// armed instances, swapped under m_armed_mutex since the prepare thread publishes them
+	std::mutex m_armed_mutex;
+	CaptureSource* m_capture;
+	Encoder* m_encoder;
+	FrameQueue* m_frame_queue;
+
+	std::wstring m_display;
+	std::string m_output_filename;
+	int32_t m_output_width;
+	int32_t m_output_height;
+	int32_t m_fps;
+	PacerWait m_pacer_wait;
+	Pacer m_pacer;
+	FramePolicy m_frame_policy;
+	int32_t m_queue_capacity;
+	EncoderMode m_encoder_mode;
+	int32_t m_bitrate;
+	RateControl m_rate_control;
+	int32_t m_crf;
+	int32_t m_max_bitrate;
+	bool m_roi;
+	KeyframePolicy m_keyframe_policy;
+	int32_t m_keyframe_interval;
+	int32_t m_write_buffer_kb;
+	int32_t m_write_buffer_count;
+	int32_t m_preallocate_mb;
+	int32_t m_segment_seconds;
+	int32_t m_segment_megabytes;
+	std::string m_live_url;
+	int32_t m_live_mux_delay_ms;
+	int32_t m_live_pace_bitrate;
+	std::string m_playlist;
+	int32_t m_playlist_segment_seconds;
+	int32_t m_playlist_list_size;
+	int32_t m_replay_seconds;
+	int32_t m_replay_megabytes;
+	PacketCallback m_packet_callback;
+	PipelineStats m_stats;
+	std::string m_stats_filename;
+	int32_t m_stats_interval_ms;
+	std::string m_trace_filename;
+	std::string m_trace_output;
+	std::atomic<bool> m_record_running;
+	std::atomic<bool> m_record_paused;
+	std::mutex m_pause_mutex;
+	std::condition_variable m_pause_cond;
+	std::chrono::steady_clock::time_point m_resume_request;
+	bool m_prepared;
+	ArmedSettings m_armed;
+	bool m_keep_warm;
+	std::thread m_prepare_thread;
+	std::thread m_record_thread;
+	std::thread m_encode_thread;
+	std::thread m_finalize_thread;
+	std::thread m_stats_thread;
+	int32_t m_finalize_deadline_ms;
+	int32_t m_encode_delay_ms;
+	std::chrono::steady_clock::time_point m_record_start;
+	std::chrono::steady_clock::time_point m_start_request;
+
+	std::atomic<int64_t> m_captured_frames;
+	std::atomic<int64_t> m_duplicated_frames;
+	std::atomic<int64_t> m_late_frames;
+	std::atomic<int64_t> m_first_capture_us;
+	std::atomic<int64_t> m_first_encode_us;
+	std::atomic<int64_t> m_resume_latency_us;
+	std::atomic<int64_t> m_finalize_us;
+	std::atomic<int64_t> m_dropped_frames;
+	std::atomic<int64_t> m_unchanged_frames;
+	std::atomic<int64_t> m_pickup_latency_sum_us;
+	std::atomic<int64_t> m_pickup_count;
+	std::atomic<int64_t> m_max_pickup_latency_us;
+	std::atomic<int64_t> m_capture_wakeups;
+	std::atomic<int64_t> m_record_us;
+};
@@ -0,0 +1,425 @@
+#include "pch.h"
+#include "RecorderApi.h"
+#include "Recorder.h"
+
+#include <stdarg.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#endif
+
+#define TRACE_MESSAGE_SIZE 1024
+
+static recorder_log_callback log_callback = nullptr;
+static void* log_opaque = nullptr;
+
+struct recorder
+{
+	Recorder core;
+
+	recorder_packet_callback packet_callback;
+	void* packet_opaque;
+	int32_t fps;
+	std::atomic<int64_t> encoded_packets;
+	std::atomic<int64_t> encoded_bytes;
+	std::atomic<int64_t> keyframe_packets;
+
+	// options set in pairs on the core, each key changes one half
+	int32_t width;
+	int32_t height;
+	int32_t write_buffer_kb;
+	int32_t write_buffer_count;
+	int32_t segment_seconds;
+	int32_t segment_megabytes;
+	std::string live_url;
+	int32_t live_mux_delay_ms;
+	int32_t live_pace_bitrate;
+	std::string playlist;
+	int32_t playlist_segment_seconds;
+	int32_t playlist_list_size;
+	int32_t replay_seconds;
+	int32_t replay_megabytes;
+	std::string stats_file;
+	int32_t stats_interval_ms;
+};
+
+void recorder_trace(const char* format, ...)
+{
+	char message[TRACE_MESSAGE_SIZE];
+	va_list args;
+
+#if defined(_WIN32) && !defined(_DEBUG)
+	// like the MFC TRACE, release builds stay silent unless the host asked for the messages
+	if (!log_callback)
+	{
+		return;
+	}
+#endif
+
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	if (log_callback)
+	{
+		log_callback(log_opaque, message);
+		return;
+	}
+
+#ifdef _WIN32
+	OutputDebugStringA(message);
+#else
+	fputs(message, stderr);
+#endif
+}
+
+static bool parse_int(const char* value, int32_t* result)
+{
+	char* end = nullptr;
+	long parsed = strtol(value, &end, 10);
+
+	if (end == value || *end != '\0')
+	{
+		return false;
+	}
+
+	*result = (int32_t)parsed;
+	return true;
+}
+
+static void on_packet(recorder* r, const AVPacket* pkt, int64_t capture_us)
+{
+	recorder_packet packet;
+
+	r->encoded_packets++;
+	r->encoded_bytes += pkt->size;
+	if (pkt->flags & AV_PKT_FLAG_KEY) r->keyframe_packets++;
+
+	if (!r->packet_callback)
+	{
+		return;
+	}
+
+	packet.data = pkt->data;
+	packet.size = pkt->size;
+	packet.keyframe = (pkt->flags & AV_PKT_FLAG_KEY) ? 1 : 0;
+	packet.pts_us = pkt->pts * (1 * 1000 * 1000) / r->fps;
+	packet.dts_us = pkt->dts * (1 * 1000 * 1000) / r->fps;
+	packet.capture_us = capture_us;
+	r->packet_callback(r->packet_opaque, &packet);
+}
+
+int32_t recorder_api_version(void)
+{
+	return RECORDER_API_VERSION;
+}
+
+void recorder_set_log_callback(recorder_log_callback callback, void* opaque)
+{
+	log_callback = callback;
+	log_opaque = opaque;
+}
+
+recorder* recorder_create(void)
+{
+	recorder* r = new recorder();
+
+	r->packet_callback = nullptr;
+	r->packet_opaque = nullptr;
+	r->fps = 0;
+	r->encoded_packets = 0;
+	r->encoded_bytes = 0;
+	r->keyframe_packets = 0;
+
+	r->width = 0;
+	r->height = 0;
+	r->write_buffer_kb = DEFAULT_WRITE_BUFFER_SIZE / 1024;
+	r->write_buffer_count = DEFAULT_WRITE_BUFFER_COUNT;
+	r->segment_seconds = 0;
+	r->segment_megabytes = 0;
+	r->live_mux_delay_ms = 0;
+	r->live_pace_bitrate = 0;
+	r->playlist_segment_seconds = 2;
+	r->playlist_list_size = 0;
+	r->replay_seconds = 0;
+	r->replay_megabytes = 0;
+	r->stats_interval_ms = 1000;
+
+	// an embedding process does not hold the display between recordings unless asked to
+	r->core.set_keep_warm(false);
+	r->core.set_packet_callback([r](const AVPacket* pkt, int64_t capture_us) {
+		on_packet(r, pkt, capture_us);
+		});
+
+	return r;
+}
+
+void recorder_destroy(recorder* r)
+{
+	if (!r)
+	{
+		return;
+	}
+
+	delete r;
+}
+
+int32_t recorder_set_option(recorder* r, const char* key, const char* value)
+{
+	int32_t number = 0;
+	bool is_number = false;
+	bool valid = true;
+
+	if (!r || !key || !value)
+	{
+		return -1;
+	}
+
+	if (r->core.is_running())
+	{
+		TRACE(_T("option %s cannot change while recording\n"), key);
+		return -1;
+	}
+
+	std::string name = key;
+	is_number = parse_int(value, &number);
+
+	if (name == "display")
+	{
+		// display names are plain ASCII device paths
+		std::string display = value;
+		r->core.set_display(std::wstring(display.begin(), display.end()).c_str());
+	}
+	else if (name == "output") r->core.set_output(value);
+	else if (name == "width") { if ((valid = is_number && number >= 0)) r->width = number; }
+	else if (name == "height") { if ((valid = is_number && number >= 0)) r->height = number; }
+	else if (name == "fps") { if ((valid = is_number && number > 0)) r->core.set_fps(number); }
+	else if (name == "pacer")
+	{
+		PacerWait wait;
+		if ((valid = Pacer::parse_wait_name(value, &wait))) r->core.set_pacer_wait(wait);
+	}
+	else if (name == "mode")
+	{
+		EncoderMode mode;
+		if ((valid = Encoder::parse_mode_name(value, &mode))) r->core.set_encoder_mode(mode);
+	}
+	else if (name == "rate_control")
+	{
+		RateControl rate_control;
+		if ((valid = Encoder::parse_rate_control_name(value, &rate_control))) r->core.set_rate_control(rate_control);
+	}
+	else if (name == "bitrate") { if ((valid = is_number && number > 0)) r->core.set_bitrate(number); }
+	else if (name == "crf") { if ((valid = is_number && number >= 0)) r->core.set_crf(number); }
+	else if (name == "max_bitrate") { if ((valid = is_number && number >= 0)) r->core.set_max_bitrate(number); }
+	else if (name == "keyframe_policy")
+	{
+		KeyframePolicy policy;
+		if ((valid = Encoder::parse_keyframe_policy_name(value, &policy))) r->core.set_keyframe_policy(policy);
+	}
+	else if (name == "keyframe_interval") { if ((valid = is_number && number >= 0)) r->core.set_keyframe_interval(number); }
+	else if (name == "frame_policy")
+	{
+		FramePolicy policy;
+		if ((valid = FrameQueue::parse_policy_name(value, &policy))) r->core.set_frame_policy(policy);
+	}
+	else if (name == "queue_capacity") { if ((valid = is_number && number > 0)) r->core.set_queue_capacity(number); }
+	else if (name == "roi") { if ((valid = is_number)) r->core.set_roi(number != 0); }
+	else if (name == "write_buffer_kb") { if ((valid = is_number && number >= 0)) r->write_buffer_kb = number; }
+	else if (name == "write_buffer_count") { if ((valid = is_number && number > 0)) r->write_buffer_count = number; }
+	else if (name == "preallocate_mb") { if ((valid = is_number && number >= 0)) r->core.set_preallocate(number); }
+	else if (name == "segment_seconds") { if ((valid = is_number && number >= 0)) r->segment_seconds = number; }
+	else if (name == "segment_megabytes") { if ((valid = is_number && number >= 0)) r->segment_megabytes = number; }
+	else if (name == "live_url") r->live_url = value;
+	else if (name == "live_mux_delay_ms") { if ((valid = is_number && number >= 0)) r->live_mux_delay_ms = number; }
+	else if (name == "live_pace_bitrate") { if ((valid = is_number && number >= 0)) r->live_pace_bitrate = number; }
+	else if (name == "playlist") r->playlist = value;
+	else if (name == "playlist_segment_seconds") { if ((valid = is_number && number > 0)) r->playlist_segment_seconds = number; }
+	else if (name == "playlist_list_size") { if ((valid = is_number && number >= 0)) r->playlist_list_size = number; }
+	else if (name == "replay_seconds") { if ((valid = is_number && number >= 0)) r->replay_seconds = number; }
+	else if (name == "replay_megabytes") { if ((valid = is_number && number >= 0)) r->replay_megabytes = number; }
+	else if (name == "finalize_deadline_ms") { if ((valid = is_number && number >= 0)) r->core.set_finalize_deadline(number); }
+	else if (name == "keep_warm") { if ((valid = is_number)) r->core.set_keep_warm(number != 0); }
+	else if (name == "stats_file") r->stats_file = value;
+	else if (name == "stats_interval_ms") { if ((valid = is_number && number > 0)) r->stats_interval_ms = number; }
+	else if (name == "trace_file") r->core.set_trace_output(value);
+	else
+	{
+		TRACE(_T("unknown option %s\n"), key);
+		return -1;
+	}
+
+	if (!valid)
+	{
+		TRACE(_T("invalid value %s for option %s\n"), value, key);
+		return -1;
+	}
+
+	r->core.set_output_size(r->width, r->height);
+	r->core.set_write_buffer(r->write_buffer_kb, r->write_buffer_count);
+	r->core.set_segment(r->segment_seconds, r->segment_megabytes);
+	r->core.set_live_output(r->live_url.c_str(), r->live_mux_delay_ms, r->live_pace_bitrate);
+	r->core.set_playlist_output(r->playlist.c_str(), r->playlist_segment_seconds, r->playlist_list_size);
+	r->core.set_replay(r->replay_seconds, r->replay_megabytes);
+	r->core.set_stats_dump(r->stats_file.c_str(), r->stats_interval_ms);
+
+	return 0;
+}
+
+int32_t recorder_set_packet_callback(recorder* r, recorder_packet_callback callback, void* opaque)
+{
+	if (!r || r->core.is_running())
+	{
+		return -1;
+	}
+
+	r->packet_callback = callback;
+	r->packet_opaque = opaque;
+
+	return 0;
+}
+
+int32_t recorder_start(recorder* r)
+{
+	if (!r)
+	{
+		return -1;
+	}
+
+	if (r->core.is_running())
+	{
+		return 0;
+	}
+
+	r->fps = r->core.get_fps();
+	r->encoded_packets = 0;
+	r->encoded_bytes = 0;
+	r->keyframe_packets = 0;
+
+	return r->core.start_record();
+}
+
+int32_t recorder_stop(recorder* r)
+{
+	int32_t result = 0;
+
+	if (!r)
+	{
+		return -1;
+	}
+
+	r->core.stop_record_async([&result](int32_t ret, int64_t) {
+		result = ret;
+		});
+	r->core.wait_finalized();
+
+	return result < 0 ? -1 : 0;
+}
+
+int32_t recorder_pause(recorder* r)
+{
+	if (!r || !r->core.is_running())
+	{
+		return -1;
+	}
+
+	r->core.pause_record();
+
+	return 0;
+}
+
+int32_t recorder_resume(recorder* r)
+{
+	if (!r || !r->core.is_running())
+	{
+		return -1;
+	}
+
+	r->core.resume_record();
+
+	return 0;
+}
+
+int32_t recorder_request_keyframe(recorder* r)
+{
+	if (!r || !r->core.is_running())
+	{
+		return -1;
+	}
+
+	r->core.request_keyframe();
+
+	return 0;
+}
+
+int32_t recorder_get_stats(recorder* r, recorder_stats* stats)
+{
+	recorder_stats snapshot;
+
+	if (!r || !stats || stats->size < sizeof(uint32_t))
+	{
+		return -1;
+	}
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.size = sizeof(snapshot);
+	snapshot.running = r->core.is_running() ? 1 : 0;
+	snapshot.captured_frames = r->core.get_captured_frames();
+	snapshot.dropped_frames = r->core.get_dropped_frames();
+	snapshot.duplicated_frames = r->core.get_duplicated_frames();
+	snapshot.late_frames = r->core.get_late_frames();
+	snapshot.encoded_packets = r->encoded_packets;
+	snapshot.encoded_bytes = r->encoded_bytes;
+	snapshot.keyframe_packets = r->keyframe_packets;
+	snapshot.first_capture_us = r->core.get_first_capture_us();
+	snapshot.first_encode_us = r->core.get_first_encode_us();
+	snapshot.finalize_us = r->core.get_finalize_us();
+	snapshot.tick_error_p50_us = r->core.get_tick_error_us(50);
+	snapshot.tick_error_p99_us = r->core.get_tick_error_us(99);
+	snapshot.unchanged_frames = r->core.get_unchanged_frames();
+	snapshot.pickup_latency_avg_us = r->core.get_average_pickup_latency_us();
+	snapshot.pickup_latency_max_us = r->core.get_max_pickup_latency_us();
+	snapshot.capture_wakeups = r->core.get_capture_wakeups();
+
+	PipelineSnapshot pipeline = r->core.get_stats();
+	snapshot.bytes_written = pipeline.bytes_written;
+	snapshot.frame_queue_depth = pipeline.frame_queue_depth;
+	snapshot.max_frame_queue_depth = pipeline.max_frame_queue_depth;
+	snapshot.write_queue_depth = pipeline.write_queue_depth;
+	snapshot.max_write_queue_depth = pipeline.max_write_queue_depth;
+	for (int32_t i = 0; i < RECORDER_STAGE_COUNT && i < PIPELINE_STAGE_COUNT; i++)
+	{
+		snapshot.stage_count[i] = pipeline.stages[i].count;
+		snapshot.stage_mean_us[i] = pipeline.stages[i].mean_us;
+		snapshot.stage_p50_us[i] = pipeline.stages[i].p50_us;
+		snapshot.stage_p99_us[i] = pipeline.stages[i].p99_us;
+		snapshot.stage_max_us[i] = pipeline.stages[i].max_us;
+	}
+	snapshot.glass_to_packet_p50_us = pipeline.glass_to_packet.p50_us;
+	snapshot.glass_to_packet_p99_us = pipeline.glass_to_packet.p99_us;
+	snapshot.glass_to_packet_max_us = pipeline.glass_to_packet.max_us;
+	for (int32_t i = 0; i < RECORDER_PACKET_SIZE_BUCKETS && i < PACKET_SIZE_BUCKETS; i++)
+	{
+		snapshot.packet_size_histogram[i] = pipeline.packet_size_histogram[i];
+	}
+
+	// an older caller gets the fields it knows about
+	uint32_t size = stats->size < sizeof(snapshot) ? stats->size : (uint32_t)sizeof(snapshot);
+	memcpy(stats, &snapshot, size);
+	stats->size = size;
+
+	return 0;
+}
+
+int32_t recorder_get_stats_json(recorder* r, char* buffer, int32_t size)
+{
+	if (!r || !buffer || size <= 0)
+	{
+		return -1;
+	}
+
+	std::string json = PipelineStats::format_json(r->core.get_stats());
+	snprintf(buffer, size, "%s", json.c_str());
+
+	return (int32_t)json.size();
+}
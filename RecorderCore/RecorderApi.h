@@ -0,0 +1,132 @@
+#ifndef RECORDER_API_H
+#define RECORDER_API_H
+
+/*
+ * C interface of the recorder core for embedding in other processes and languages.
+ *
+ * Functions return 0 on success and -1 on error unless noted otherwise. A recorder handle is used
+ * from one controlling thread; the packet callback runs on the encode thread and the log callback
+ * on whichever thread emits the message.
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(RECORDER_SHARED)
+#ifdef RECORDER_BUILD
+#define RECORDER_API __declspec(dllexport)
+#else
+#define RECORDER_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define RECORDER_API __attribute__((visibility("default")))
+#else
+#define RECORDER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped whenever a function or struct below changes incompatibly */
+#define RECORDER_API_VERSION 1
+
+typedef struct recorder recorder;
+
+/* timed pipeline stages in the order acquire, copy, convert, encode, mux, write */
+#define RECORDER_STAGE_COUNT 6
+/* bucket i of the packet size histogram counts packets of [2^i, 2^(i+1)) bytes */
+#define RECORDER_PACKET_SIZE_BUCKETS 32
+
+/* one H.264 access unit in Annex B format, SPS and PPS are repeated in band before each IDR */
+typedef struct recorder_packet
+{
+	const uint8_t* data;	/* valid only during the callback */
+	int32_t size;
+	int32_t keyframe;		/* non zero for an IDR */
+	int64_t pts_us;			/* presentation time since record start */
+	int64_t dts_us;			/* decode time, earlier than pts_us when B-frames are enabled */
+	int64_t capture_us;		/* capture time of the frame since record start */
+} recorder_packet;
+
+/* set size to sizeof(recorder_stats) before calling recorder_get_stats, fields are only ever appended */
+typedef struct recorder_stats
+{
+	uint32_t size;
+	int32_t running;
+	int64_t captured_frames;
+	int64_t dropped_frames;
+	int64_t duplicated_frames;
+	int64_t late_frames;
+	int64_t encoded_packets;
+	int64_t encoded_bytes;
+	int64_t keyframe_packets;
+	int64_t first_capture_us;	/* start to first captured frame, -1 until then */
+	int64_t first_encode_us;	/* start to first encoded frame, -1 until then */
+	int64_t finalize_us;		/* last stop to the output being closed */
+	int64_t tick_error_p50_us;	/* distance of capture ticks from their deadlines */
+	int64_t tick_error_p99_us;
+	int64_t unchanged_frames;	/* ticks without new content, the previous picture is repeated */
+	int64_t pickup_latency_avg_us;	/* new content signalled by the source to its capture on a tick */
+	int64_t pickup_latency_max_us;
+	int64_t capture_wakeups;	/* capture thread wakeups, with or without new content */
+	int64_t bytes_written;		/* output file bytes that reached the disk */
+	int32_t frame_queue_depth;	/* raw frames waiting for the encoder */
+	int32_t max_frame_queue_depth;
+	int32_t write_queue_depth;	/* write buffers waiting for the disk */
+	int32_t max_write_queue_depth;
+	int64_t stage_count[RECORDER_STAGE_COUNT];
+	int64_t stage_mean_us[RECORDER_STAGE_COUNT];
+	int64_t stage_p50_us[RECORDER_STAGE_COUNT];
+	int64_t stage_p99_us[RECORDER_STAGE_COUNT];
+	int64_t stage_max_us[RECORDER_STAGE_COUNT];
+	int64_t glass_to_packet_p50_us;	/* new picture from the source to its encoded packet */
+	int64_t glass_to_packet_p99_us;
+	int64_t glass_to_packet_max_us;
+	int64_t packet_size_histogram[RECORDER_PACKET_SIZE_BUCKETS];
+} recorder_stats;
+
+typedef void (*recorder_packet_callback)(void* opaque, const recorder_packet* packet);
+typedef void (*recorder_log_callback)(void* opaque, const char* message);
+
+RECORDER_API int32_t recorder_api_version(void);
+
+/* messages of every recorder in the process, NULL restores the default of stderr or the debugger output */
+RECORDER_API void recorder_set_log_callback(recorder_log_callback callback, void* opaque);
+
+RECORDER_API recorder* recorder_create(void);
+/* stops a running recording and waits for its output to be finalized */
+RECORDER_API void recorder_destroy(recorder* r);
+
+/*
+ * options are strings and can only be changed while stopped
+ *   display, output (empty for packets only), width, height, fps,
+ *   mode (low-latency, throughput, archival), rate_control (abr, crf, capped-crf, cbr),
+ *   pacer (sleep, precise), bitrate, crf, max_bitrate, keyframe_policy (fixed-gop, intra-refresh, long-gop), keyframe_interval,
+ *   frame_policy (drop-newest, drop-oldest, duplicate-last), queue_capacity, roi,
+ *   write_buffer_kb, write_buffer_count, preallocate_mb, segment_seconds, segment_megabytes,
+ *   live_url, live_mux_delay_ms, live_pace_bitrate, playlist, playlist_segment_seconds, playlist_list_size,
+ *   replay_seconds, replay_megabytes, finalize_deadline_ms, keep_warm,
+ *   stats_file (JSON lines appended while recording, empty to disable), stats_interval_ms,
+ *   trace_file (Chrome trace event timeline written after stop, empty to disable)
+ * an unknown key or an invalid value returns -1 and leaves the configuration unchanged
+ */
+RECORDER_API int32_t recorder_set_option(recorder* r, const char* key, const char* value);
+/* called for every encoded packet on the encode thread, it must return quickly */
+RECORDER_API int32_t recorder_set_packet_callback(recorder* r, recorder_packet_callback callback, void* opaque);
+
+RECORDER_API int32_t recorder_start(recorder* r);
+/* returns once the output is closed, -1 when finalizing failed or was cut short by finalize_deadline_ms */
+RECORDER_API int32_t recorder_stop(recorder* r);
+RECORDER_API int32_t recorder_pause(recorder* r);
+RECORDER_API int32_t recorder_resume(recorder* r);
+RECORDER_API int32_t recorder_request_keyframe(recorder* r);
+
+RECORDER_API int32_t recorder_get_stats(recorder* r, recorder_stats* stats);
+/* the same snapshot as one JSON object, returns its length or -1, the text is cut to fit size including the terminator */
+RECORDER_API int32_t recorder_get_stats_json(recorder* r, char* buffer, int32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_API_H */
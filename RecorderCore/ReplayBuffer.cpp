@@ -0,0 +1,222 @@
+#include "pch.h"
+#include "ReplayBuffer.h"
+#include "Muxer.h"
+
+ReplayBuffer::ReplayBuffer() :
+	m_second_gop(-1),
+	m_bytes(0),
+	m_last_dts(AV_NOPTS_VALUE),
+	m_max_bytes(0),
+	m_max_duration(0),
+	m_evicted_gops(0),
+	m_codecpar(nullptr),
+	m_time_base({ 0, 1 }),
+	m_saving(false)
+{
+
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+	wait_saved();
+
+	if (m_codecpar)
+	{
+		avcodec_parameters_free(&m_codecpar);
+		m_codecpar = nullptr;
+	}
+}
+
+int32_t ReplayBuffer::initialize(const AVCodecContext* codec_context, int64_t max_bytes, int64_t max_duration)
+{
+	if (max_bytes < 0 || max_duration <= 0)
+	{
+		TRACE(_T("replay buffer size invalid\n"));
+		return -1;
+	}
+
+	// stream description is kept so a save never touches the live encoder
+	m_codecpar = avcodec_parameters_alloc();
+	if (!m_codecpar || avcodec_parameters_from_context(m_codecpar, codec_context) < 0)
+	{
+		TRACE(_T("cannot copy codec parameters\n"));
+		return -1;
+	}
+
+	m_time_base = codec_context->time_base;
+	m_max_bytes = max_bytes;
+	m_max_duration = max_duration;
+
+	// a full window plus the GOP that is being added before the oldest one goes, the queue grows past it if needed
+	if (m_packets.initialize((int32_t)max_duration + (codec_context->gop_size > 0 ? codec_context->gop_size : 1) + 1) < 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+int32_t ReplayBuffer::push(const AVPacket* pkt)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	bool keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+	if (!keyframe && m_packets.empty())
+	{
+		// nothing to decode from until the next keyframe
+		return 0;
+	}
+
+	// shares the encoded payload, no copy
+	if (m_packets.push(pkt, std::chrono::steady_clock::time_point()) < 0)
+	{
+		TRACE(_T("cannot reference replay packet\n"));
+		return -1;
+	}
+	if (keyframe && m_second_gop < 0 && m_packets.size() > 1)
+	{
+		m_second_gop = m_packets.size() - 1;
+	}
+
+	m_bytes += pkt->size;
+	m_last_dts = pkt->dts;
+
+	evict();
+
+	return 0;
+}
+
+void ReplayBuffer::evict()
+{
+	// the newest GOP is kept for the duration limit, the byte limit is a hard bound
+	while (!m_packets.empty())
+	{
+		bool over_bytes = m_max_bytes > 0 && m_bytes > m_max_bytes;
+		bool over_duration = m_second_gop > 0 && m_last_dts - m_packets.at(m_second_gop).pkt->dts >= m_max_duration;
+		if (!over_bytes && !over_duration)
+		{
+			break;
+		}
+
+		// the oldest GOP goes whole, the next one moves to the front
+		int32_t gop_packets = m_second_gop > 0 ? m_second_gop : m_packets.size();
+		for (int32_t i = 0; i < gop_packets; i++)
+		{
+			m_bytes -= m_packets.front().pkt->size;
+			m_packets.pop_front(nullptr);
+		}
+		m_evicted_gops++;
+
+		m_second_gop = -1;
+		for (int32_t i = 1; i < m_packets.size(); i++)
+		{
+			if (m_packets.at(i).pkt->flags & AV_PKT_FLAG_KEY)
+			{
+				m_second_gop = i;
+				break;
+			}
+		}
+	}
+}
+
+int32_t ReplayBuffer::save(const char* filename, ReplaySaveCallback callback)
+{
+	std::vector<AVPacket*> packets;
+
+	// also refuses a save from the callback of the previous one, which runs on the save thread itself
+	if (m_saving.exchange(true))
+	{
+		TRACE(_T("replay save already in progress\n"));
+		return -1;
+	}
+
+	if (m_save_thread.joinable())
+	{
+		m_save_thread.join();
+	}
+
+	{
+		// only references are taken under the lock, the encoder keeps going
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		packets.reserve(m_packets.size());
+		for (int32_t i = 0; i < m_packets.size(); i++)
+		{
+			AVPacket* ref = av_packet_clone(m_packets.at(i).pkt);
+			if (ref) packets.push_back(ref);
+		}
+	}
+
+	if (packets.empty())
+	{
+		TRACE(_T("replay buffer is empty\n"));
+		m_saving = false;
+		return -1;
+	}
+
+	m_save_thread = std::move(std::thread(&ReplayBuffer::save_thread, this, std::string(filename), std::move(packets), callback));
+
+	return 0;
+}
+
+void ReplayBuffer::save_thread(std::string filename, std::vector<AVPacket*> packets, ReplaySaveCallback callback)
+{
+	std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+	int32_t ret = 0;
+	Muxer muxer;
+
+	// saved file starts at zero decode time
+	int64_t offset = packets.front()->dts;
+
+	ret = muxer.open(filename.c_str(), m_codecpar, m_time_base);
+	for (auto pkt : packets)
+	{
+		if (ret == 0)
+		{
+			pkt->pts -= offset;
+			pkt->dts -= offset;
+			ret = muxer.write_packet(pkt);
+		}
+		av_packet_free(&pkt);
+	}
+
+	if (muxer.close() < 0) ret = -1;
+
+	TRACE(_T("replay saved to %s (%d), %d packets in %lld us\n"), filename.c_str(), ret, (int32_t)packets.size(),
+		(long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_start).count());
+
+	if (callback)
+	{
+		callback(ret, filename);
+	}
+
+	// only now, a save started from the callback would join this thread from itself
+	m_saving = false;
+}
+
+void ReplayBuffer::wait_saved()
+{
+	if (m_save_thread.joinable())
+	{
+		m_save_thread.join();
+	}
+}
+
+int64_t ReplayBuffer::get_buffered_bytes()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_bytes;
+}
+
+int64_t ReplayBuffer::get_buffered_duration()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_packets.empty())
+	{
+		return 0;
+	}
+
+	return m_last_dts - m_packets.front().pkt->dts + 1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PacketQueue.h"
+
+// called from the save thread once the file is closed
+typedef std::function<void(int32_t result, const std::string& filename)> ReplaySaveCallback;
+
+// most recent encoded packets kept in memory, grouped by GOP so the window always starts on a keyframe
+class ReplayBuffer
+{
+public:
+	ReplayBuffer();
+	~ReplayBuffer();
+
+	// max_duration is in codec time base, the oldest GOP is evicted whole once either limit is exceeded,
+	// max_bytes 0 bounds the window by duration only
+	int32_t initialize(const AVCodecContext* codec_context, int64_t max_bytes, int64_t max_duration);
+	int32_t push(const AVPacket* pkt);
+
+	// snapshot of the window is muxed on a background thread, one save at a time, the callback
+	// counts as part of the save so it cannot start the next one
+	int32_t save(const char* filename, ReplaySaveCallback callback);
+	void wait_saved();
+
+	int64_t get_buffered_bytes();
+	int64_t get_buffered_duration();
+	int64_t get_evicted_gops() { return m_evicted_gops; }
+
+private:
+	void evict();
+	void save_thread(std::string filename, std::vector<AVPacket*> packets, ReplaySaveCallback callback);
+
+	std::mutex m_mutex;
+	// starts on a keyframe, the slots are reused once the window is full
+	PacketQueue m_packets;
+	// position in m_packets where the second GOP starts, -1 while there is only one
+	int32_t m_second_gop;
+	int64_t m_bytes;
+	int64_t m_last_dts;
+	int64_t m_max_bytes;
+	int64_t m_max_duration;
+	int64_t m_evicted_gops;
+
+	AVCodecParameters* m_codecpar;
+	AVRational m_time_base;
+
+	std::atomic<bool> m_saving;
+	std::thread m_save_thread;
+};
@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "SyntheticSource.h"
+#include "FrameKernels.h"
+#include "FrameStamp.h"
+
+#include <random>
+
+SyntheticSource::SyntheticSource() :
+	m_width(0),
+	m_height(0),
+	m_mean_interval_ms(33),
+	m_content(SYNTHETIC_CONTENT_BLOCK),
+	m_stamp(false),
+	m_frame_buffer(nullptr),
+	m_frame_buffer_len(0),
+	m_block_x(0),
+	m_block_y(0),
+	m_scroll(0),
+	m_region_count(0),
+	m_capture_running(false)
+{
+}
+
+SyntheticSource::~SyntheticSource()
+{
+	stop_capture();
+
+	if (m_frame_buffer)
+	{
+		delete[] m_frame_buffer;
+		m_frame_buffer = nullptr;
+	}
+}
+
+const char* SyntheticSource::get_content_name(SyntheticContent content)
+{
+	switch (content)
+	{
+	case SYNTHETIC_CONTENT_BLOCK:
+		return "block";
+	case SYNTHETIC_CONTENT_SCROLL:
+		return "scroll";
+	default:
+		break;
+	}
+
+	return "unknown content";
+}
+
+int32_t SyntheticSource::initialize(int32_t width, int32_t height, int32_t mean_interval_ms)
+{
+	if (width < SYNTHETIC_BLOCK_SIZE || height < SYNTHETIC_BLOCK_SIZE || mean_interval_ms <= 0)
+	{
+		TRACE(_T("invalid synthetic source %dx%d every %d ms\n"), width, height, mean_interval_ms);
+		return -1;
+	}
+
+	// even sizes like a real display, the encoder works on 4:2:0
+	m_width = width & ~1;
+	m_height = height & ~1;
+	m_mean_interval_ms = mean_interval_ms;
+	m_frame_buffer_len = m_width * m_height * 4;
+
+	m_frame_buffer = new uint8_t[m_frame_buffer_len];
+	if (!m_frame_buffer)
+	{
+		return -1;
+	}
+
+	draw_background(0, 0, m_width, m_height);
+	draw_block(m_block_x, m_block_y, 0xFFFFFFFF);
+
+	TRACE(_T("synthetic source %dx%d, an update every %d ms on average\n"), m_width, m_height, m_mean_interval_ms);
+
+	return 0;
+}
+
+void SyntheticSource::draw_background(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+	for (int32_t y = top; y < bottom; y++)
+	{
+		uint8_t* p = m_frame_buffer + ((int64_t)y * m_width + left) * 4;
+		for (int32_t x = left; x < right; x++)
+		{
+			p[0] = (uint8_t)x;
+			p[1] = (uint8_t)(y + m_scroll);
+			p[2] = 0x40;
+			p[3] = 0xFF;
+			p += 4;
+		}
+	}
+}
+
+void SyntheticSource::draw_block(int32_t left, int32_t top, uint32_t color)
+{
+	for (int32_t y = top; y < top + SYNTHETIC_BLOCK_SIZE; y++)
+	{
+		uint32_t* p = (uint32_t*)(m_frame_buffer + ((int64_t)y * m_width + left) * 4);
+		for (int32_t x = 0; x < SYNTHETIC_BLOCK_SIZE; x++)
+		{
+			p[x] = color;
+		}
+	}
+}
+
+void SyntheticSource::event_thread()
+{
+	std::mt19937 random(12345);
+	std::exponential_distribution<double> interval(1.0 / m_mean_interval_ms);
+	std::uniform_int_distribution<int32_t> step(-SYNTHETIC_BLOCK_SIZE, SYNTHETIC_BLOCK_SIZE);
+	uint32_t color = 0xFFFFFFFF;
+
+	Tracer::set_thread_name("capture");
+
+	for (;;)
+	{
+		int64_t wait_us = (int64_t)(interval(random) * 1000);
+		if (wait_us < 1000) wait_us = 1000;
+
+		{
+			std::unique_lock<std::mutex> lock(m_stop_mutex);
+			if (m_stop_cond.wait_for(lock, std::chrono::microseconds(wait_us), [=]() { return !m_capture_running; }))
+			{
+				break;
+			}
+		}
+		count_wakeup();
+
+		// random walk inside the frame, the old position is restored to the background
+		int32_t x = m_block_x + step(random);
+		int32_t y = m_block_y + step(random);
+		if (x < 0) x = 0;
+		if (x > m_width - SYNTHETIC_BLOCK_SIZE) x = m_width - SYNTHETIC_BLOCK_SIZE;
+		if (y < 0) y = 0;
+		if (y > m_height - SYNTHETIC_BLOCK_SIZE) y = m_height - SYNTHETIC_BLOCK_SIZE;
+		color = color * 1103515245 + 12345;
+
+		std::chrono::steady_clock::time_point t_acquire = std::chrono::steady_clock::now();
+		m_mutex.lock();
+		if (m_content == SYNTHETIC_CONTENT_SCROLL)
+		{
+			m_scroll += SYNTHETIC_SCROLL_STEP;
+			draw_background(0, 0, m_width, m_height);
+			add_frame_region(m_regions, &m_region_count, { 0, 0, m_width, m_height });
+		}
+		else
+		{
+			draw_background(m_block_x, m_block_y, m_block_x + SYNTHETIC_BLOCK_SIZE, m_block_y + SYNTHETIC_BLOCK_SIZE);
+			add_frame_region(m_regions, &m_region_count, { m_block_x, m_block_y, m_block_x + SYNTHETIC_BLOCK_SIZE, m_block_y + SYNTHETIC_BLOCK_SIZE });
+			add_frame_region(m_regions, &m_region_count, { x, y, x + SYNTHETIC_BLOCK_SIZE, y + SYNTHETIC_BLOCK_SIZE });
+		}
+		draw_block(x, y, color | 0xFF000000);
+		// painted last so neither the block nor the background covers it, the stamp time is the glass time
+		if (m_stamp && m_width >= FRAME_STAMP_WIDTH && m_height >= FRAME_STAMP_HEIGHT)
+		{
+			FrameStamp stamp;
+			stamp.sequence = get_frame_sequence() + 1;
+			stamp.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+			paint_frame_stamp(m_frame_buffer, (int64_t)m_width * 4, stamp);
+			add_frame_region(m_regions, &m_region_count, { 0, 0, FRAME_STAMP_WIDTH, FRAME_STAMP_HEIGHT });
+		}
+		m_block_x = x;
+		m_block_y = y;
+		m_mutex.unlock();
+		if (m_stats) m_stats->add_stage(PIPELINE_STAGE_ACQUIRE, t_acquire, get_frame_sequence() + 1);
+
+		signal_frame();
+	}
+}
+
+void SyntheticSource::start_capture()
+{
+	if (m_capture_running || !m_frame_buffer)
+	{
+		return;
+	}
+
+	m_capture_running = true;
+	m_event_thread = std::move(std::thread([=]() {
+		event_thread();
+		}));
+}
+
+void SyntheticSource::stop_capture()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_stop_mutex);
+		m_capture_running = false;
+	}
+	m_stop_cond.notify_all();
+
+	if (m_event_thread.joinable())
+	{
+		m_event_thread.join();
+	}
+}
+
+int32_t SyntheticSource::get_frame_data(uint8_t* buffer, FrameInfo* info)
+{
+	if (!m_frame_buffer)
+	{
+		return -1;
+	}
+
+	m_mutex.lock();
+	memcpy(buffer, m_frame_buffer, m_frame_buffer_len);
+
+	if (info)
+	{
+		info->region_count = m_region_count;
+		for (int32_t i = 0; i < m_region_count; i++)
+		{
+			info->regions[i] = m_regions[i];
+		}
+		info->cursor_visible = false;
+	}
+
+	m_region_count = 0;
+	m_mutex.unlock();
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "CaptureSource.h"
+
+// side length of the block moved on every synthetic update
+#define SYNTHETIC_BLOCK_SIZE 64
+// rows the picture moves on every scroll update
+#define SYNTHETIC_SCROLL_STEP 8
+
+// what changes on every synthetic update
+enum SyntheticContent
+{
+	SYNTHETIC_CONTENT_BLOCK,	// a small block moves, like a pointer or typing on a desktop
+	SYNTHETIC_CONTENT_SCROLL,	// the whole picture scrolls, like video playback or a scrolled page
+};
+
+// generated BGRA frames, a block moves at exponentially distributed intervals so updates arrive irregularly
+// like on a real desktop, usable on any platform for latency and wakeup measurements
+class SyntheticSource : public CaptureSource
+{
+public:
+	SyntheticSource();
+	~SyntheticSource();
+
+	// mean_interval_ms is the average time between updates
+	int32_t initialize(int32_t width, int32_t height, int32_t mean_interval_ms);
+	// set before start_capture
+	void set_content(SyntheticContent content) { m_content = content; }
+	// every update also paints a FrameStamp with its sequence and time, for end to end latency probes
+	void set_stamp(bool stamp) { m_stamp = stamp; }
+	static const char* get_content_name(SyntheticContent content);
+	int32_t get_width() override { return m_width; }
+	int32_t get_height() override { return m_height; }
+	int32_t get_bytepixel() override { return 4; }
+	int32_t get_frame_buffer_length() override { return m_frame_buffer_len; }
+	int32_t get_frame_data(uint8_t* buffer, FrameInfo* info = nullptr) override;
+
+	void start_capture() override;
+	void stop_capture() override;
+
+private:
+	void event_thread();
+	void draw_background(int32_t left, int32_t top, int32_t right, int32_t bottom);
+	void draw_block(int32_t left, int32_t top, uint32_t color);
+
+	int32_t m_width;
+	int32_t m_height;
+	int32_t m_mean_interval_ms;
+	SyntheticContent m_content;
+	bool m_stamp;
+	uint8_t* m_frame_buffer;
+	int32_t m_frame_buffer_len;
+
+	int32_t m_block_x;
+	int32_t m_block_y;
+	int32_t m_scroll;
+	// changes since the last get_frame_data, the old and the new block position of every update
+	int32_t m_region_count;
+	FrameRegion m_regions[MAX_FRAME_REGIONS];
+
+	std::mutex m_mutex;
+	std::mutex m_stop_mutex;
+	std::condition_variable m_stop_cond;
+	bool m_capture_running;
+	std::thread m_event_thread;
+};
@@ -0,0 +1,235 @@
+#include "pch.h"
+#include "Tracer.h"
+
+#include <new>
+#include <vector>
+
+struct TraceEvent
+{
+	const char* name;
+	int64_t start_ns;		// steady clock
+	int64_t duration_ns;
+	int64_t frame;
+};
+
+// written only by its thread, count is published after the event so stop reads complete events
+struct TraceBuffer
+{
+	int32_t id;
+	std::atomic<const char*> thread_name;
+	std::atomic<int64_t> generation;
+	std::atomic<int64_t> count;
+	std::atomic<int64_t> dropped;
+	std::atomic<bool> retired;
+	TraceEvent* chunks[TRACE_MAX_CHUNKS];
+};
+
+// marks the buffer for release when its thread exits
+struct TraceThread
+{
+	TraceBuffer* buffer;
+	const char* name;
+
+	~TraceThread()
+	{
+		if (buffer) buffer->retired = true;
+	}
+};
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+static std::mutex trace_mutex;
+static std::vector<TraceBuffer*> trace_buffers;
+static std::atomic<int64_t> trace_generation(0);
+static std::chrono::steady_clock::time_point trace_origin;
+static int32_t trace_next_thread_id = 1;
+static thread_local TraceThread trace_thread = { nullptr, nullptr };
+
+static int64_t to_ns(std::chrono::steady_clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static TraceBuffer* register_thread()
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	TraceBuffer* buffer = new (std::nothrow) TraceBuffer();
+	if (!buffer)
+	{
+		return nullptr;
+	}
+
+	buffer->id = trace_next_thread_id++;
+	buffer->thread_name = trace_thread.name;
+	buffer->generation = trace_generation.load();
+	buffer->count = 0;
+	buffer->dropped = 0;
+	buffer->retired = false;
+	for (int32_t i = 0; i < TRACE_MAX_CHUNKS; i++)
+	{
+		buffer->chunks[i] = nullptr;
+	}
+
+	trace_buffers.push_back(buffer);
+	trace_thread.buffer = buffer;
+
+	return buffer;
+}
+
+// called with trace_mutex held, buffers of exited threads have nothing left to record
+static void release_retired_buffers()
+{
+	for (size_t i = 0; i < trace_buffers.size();)
+	{
+		TraceBuffer* buffer = trace_buffers[i];
+		if (!buffer->retired)
+		{
+			i++;
+			continue;
+		}
+
+		for (int32_t c = 0; c < TRACE_MAX_CHUNKS; c++)
+		{
+			delete[] buffer->chunks[c];
+		}
+		delete buffer;
+		trace_buffers.erase(trace_buffers.begin() + i);
+	}
+}
+
+void Tracer::start()
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	release_retired_buffers();
+
+	// live threads drop their old events lazily on their next event
+	trace_origin = std::chrono::steady_clock::now();
+	trace_generation++;
+	s_enabled = true;
+}
+
+int32_t Tracer::stop(const char* filename)
+{
+	int64_t events = 0;
+	int64_t dropped = 0;
+	int64_t origin_ns = 0;
+	FILE* file = nullptr;
+
+	s_enabled = false;
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	file = fopen(filename, "w");
+	if (!file)
+	{
+		TRACE(_T("cannot open trace file %s\n"), filename);
+		release_retired_buffers();
+		return -1;
+	}
+
+	origin_ns = to_ns(trace_origin);
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"recorder\"}}");
+
+	for (TraceBuffer* buffer : trace_buffers)
+	{
+		// a thread without events in this trace still holds those of an earlier one
+		if (buffer->generation != trace_generation)
+		{
+			continue;
+		}
+
+		const char* thread_name = buffer->thread_name;
+		int64_t count = buffer->count.load(std::memory_order_acquire);
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			buffer->id, thread_name ? thread_name : "thread");
+
+		for (int64_t i = 0; i < count; i++)
+		{
+			const TraceEvent& event = buffer->chunks[i / TRACE_CHUNK_EVENTS][i % TRACE_CHUNK_EVENTS];
+
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				event.name, buffer->id, (event.start_ns - origin_ns) / 1000.0, event.duration_ns / 1000.0);
+			if (event.frame >= 0)
+			{
+				fprintf(file, ",\"args\":{\"frame\":%lld}", (long long)event.frame);
+			}
+			fputc('}', file);
+		}
+
+		events += count;
+		dropped += buffer->dropped;
+	}
+
+	fprintf(file, "\n],\"otherData\":{\"dropped_events\":%lld}}\n", (long long)dropped);
+	fclose(file);
+
+	release_retired_buffers();
+
+	TRACE(_T("trace of %lld events written to %s, %lld dropped\n"), (long long)events, filename, (long long)dropped);
+
+	return 0;
+}
+
+void Tracer::set_thread_name(const char* name)
+{
+	trace_thread.name = name;
+	if (trace_thread.buffer)
+	{
+		trace_thread.buffer->thread_name = name;
+	}
+}
+
+void Tracer::add_event(const char* name, std::chrono::steady_clock::time_point start,
+	std::chrono::steady_clock::time_point end, int64_t frame)
+{
+	TraceBuffer* buffer = trace_thread.buffer;
+	int64_t generation = trace_generation.load(std::memory_order_relaxed);
+
+	if (!buffer)
+	{
+		buffer = register_thread();
+		if (!buffer)
+		{
+			return;
+		}
+	}
+
+	// first event of this thread in a new trace
+	if (buffer->generation.load(std::memory_order_relaxed) != generation)
+	{
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->dropped = 0;
+		buffer->generation = generation;
+	}
+
+	int64_t index = buffer->count.load(std::memory_order_relaxed);
+	int64_t chunk = index / TRACE_CHUNK_EVENTS;
+	if (chunk >= TRACE_MAX_CHUNKS)
+	{
+		buffer->dropped++;
+		return;
+	}
+
+	// chunks are kept across traces, a long running thread allocates only once
+	if (!buffer->chunks[chunk])
+	{
+		buffer->chunks[chunk] = new (std::nothrow) TraceEvent[TRACE_CHUNK_EVENTS];
+		if (!buffer->chunks[chunk])
+		{
+			buffer->dropped++;
+			return;
+		}
+	}
+
+	TraceEvent& event = buffer->chunks[chunk][index % TRACE_CHUNK_EVENTS];
+	event.name = name;
+	event.start_ns = to_ns(start);
+	event.duration_ns = to_ns(end) - event.start_ns;
+	event.frame = frame;
+
+	buffer->count.store(index + 1, std::memory_order_release);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+// events are stored per thread in chunks, a thread records at most TRACE_CHUNK_EVENTS * TRACE_MAX_CHUNKS per trace
+#define TRACE_CHUNK_EVENTS 4096
+#define TRACE_MAX_CHUNKS 256
+
+// process wide timeline of pipeline work in Chrome trace event format, viewable in chrome://tracing or Perfetto.
+// Recording is opt-in, while disabled every trace point costs one predictable branch on a global flag.
+// Each thread appends to its own buffer without locks, the buffers are only read by stop.
+class Tracer
+{
+public:
+	static bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	// discards the events of the previous trace and starts recording
+	static void start();
+	// stops recording and writes every thread's events to filename, returns -1 when the file cannot be written
+	static int32_t stop(const char* filename);
+
+	// label of the calling thread in the timeline, name must stay valid for the life of the process
+	static void set_thread_name(const char* name);
+	// one complete event, name must stay valid until stop, frame < 0 when the work belongs to no single frame
+	static void add_event(const char* name, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end, int64_t frame);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+// records the lifetime of the scope as one event when tracing is enabled
+class TraceScope
+{
+public:
+	TraceScope(const char* name, int64_t frame = -1) :
+		m_name(name),
+		m_frame(frame),
+		m_enabled(Tracer::is_enabled())
+	{
+		if (m_enabled) m_start = std::chrono::steady_clock::now();
+	}
+
+	~TraceScope()
+	{
+		if (m_enabled) Tracer::add_event(m_name, m_start, std::chrono::steady_clock::now(), m_frame);
+	}
+
+private:
+	const char* m_name;
+	int64_t m_frame;
+	bool m_enabled;
+	std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,3 @@
+// pch.cpp: source file creating the precompiled header
+
+#include "pch.h"
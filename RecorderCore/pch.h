@@ -0,0 +1,40 @@
+// pch.h: precompiled header of the recorder core.
+// The core has no MFC dependency so it can be linked into services and built on other platforms.
+
+#ifndef PCH_H
+#define PCH_H
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <SDKDDKVer.h>
+#include <windows.h>
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <string>
+
+// stands in for the MFC TRACE macro, messages go to the callback set with recorder_set_log_callback
+#if defined(__GNUC__) || defined(__clang__)
+void recorder_trace(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#else
+void recorder_trace(const char* format, ...);
+#endif
+#define TRACE recorder_trace
+#ifndef _T
+#define _T(x) x
+#endif
+
+#endif //PCH_H
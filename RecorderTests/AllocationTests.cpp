@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "Encoder.h"
+#include "PipelineStats.h"
+#include "SyntheticSource.h"
+#include "Tests.h"
+
+// frames until the pools, the replay window and the playlist sender have reached their working size
+#define ALLOCATION_WARMUP_FRAMES 120
+#define ALLOCATION_COUNTED_FRAMES 300
+
+// every C++ heap allocation of the process, the recorder threads included
+static std::atomic<int64_t> heap_allocations(0);
+
+void* operator new(size_t size)
+{
+	heap_allocations++;
+
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// A file output through the async writer, the replay buffer, an HLS playlist, region of interest side data
+// and the stats histograms are all fed while the counter runs. Only allocations made by the recorder are seen,
+// libavcodec and libavformat keep allocating small reference wrappers of their own on every packet.
+bool test_steady_state_allocations()
+{
+	const int32_t width = 640;
+	const int32_t height = 360;
+	const int32_t fps = 30;
+	bool passed = true;
+
+	SyntheticSource source;
+	if (!check(source.initialize(width, height, 1000 / fps) == 0, "cannot initialize synthetic source"))
+	{
+		return false;
+	}
+	source.start_capture();
+
+	PipelineStats stats;
+	Encoder* encoder = new Encoder();
+	encoder->set_width(width);
+	encoder->set_height(height);
+	encoder->set_bytepixel(4);
+	encoder->set_fps(fps);
+	encoder->set_bitrate(1000000);
+	encoder->set_roi(true);
+	encoder->set_replay(2, 64 * 1024 * 1024);
+	encoder->set_write_buffer(DEFAULT_WRITE_BUFFER_SIZE, DEFAULT_WRITE_BUFFER_COUNT);
+	encoder->set_stats(&stats);
+	encoder->set_packet_callback([](const AVPacket*, int64_t) {});
+
+	if (!check(encoder->initialize() == 0, "cannot initialize encoder") ||
+		!check(encoder->output_open("allocations.mp4") == 0, "cannot open allocations.mp4") ||
+		!check(encoder->playlist_open("allocations.m3u8", 1, 3) == 0, "cannot open allocations.m3u8"))
+	{
+		source.stop_capture();
+		delete encoder;
+		return false;
+	}
+
+	std::vector<uint8_t> frame(source.get_frame_buffer_length());
+	FrameInfo info = {};
+	int64_t counted_allocations = 0;
+
+	for (int32_t i = 0; i < ALLOCATION_WARMUP_FRAMES + ALLOCATION_COUNTED_FRAMES && passed; i++)
+	{
+		if (i == ALLOCATION_WARMUP_FRAMES)
+		{
+			// the playlist sender opens its muxer on its own thread, give it time to start sending
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			counted_allocations = heap_allocations;
+		}
+
+		source.get_frame_data(frame.data(), &info);
+		info.pts = i;
+		info.capture_us = (int64_t)i * 1000000 / fps;
+		info.present_us = -1;
+		info.cursor_visible = (i % 2) == 0;
+		info.cursor.left = 16;
+		info.cursor.top = 16;
+		info.cursor.right = 48;
+		info.cursor.bottom = 48;
+
+		// duplicates take the same path with the regions of the repeated picture
+		if (i % 10 == 9) passed = check(encoder->encode_duplicate(i) == 0, "encode_duplicate failed at frame %d", i);
+		else passed = check(encoder->encode_frame(frame.data(), info) == 0, "encode_frame failed at frame %d", i);
+	}
+	counted_allocations = heap_allocations - counted_allocations;
+
+	encoder->output_close();
+	source.stop_capture();
+
+	passed = check(counted_allocations == 0, "%lld heap allocations over %d steady state frames",
+		(long long)counted_allocations, ALLOCATION_COUNTED_FRAMES) && passed;
+	passed = check(encoder->get_encoded_packets() == ALLOCATION_WARMUP_FRAMES + ALLOCATION_COUNTED_FRAMES,
+		"%lld packets for %d frames", (long long)encoder->get_encoded_packets(), ALLOCATION_WARMUP_FRAMES + ALLOCATION_COUNTED_FRAMES) && passed;
+
+	delete encoder;
+
+	return passed;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+
+#include <vector>
+
+#include "Encoder.h"
+#include "SyntheticSource.h"
+#include "Tests.h"
+
+#define ENCODER_TEST_FRAMES 90
+
+// every mode, B-frames and lookahead included, hands back one packet per submitted frame once flushed
+bool test_encoder_packet_count()
+{
+	const int32_t width = 640;
+	const int32_t height = 360;
+	const int32_t fps = 30;
+	bool passed = true;
+
+	SyntheticSource source;
+	if (!check(source.initialize(width, height, 1000 / fps) == 0, "cannot initialize synthetic source"))
+	{
+		return false;
+	}
+	source.start_capture();
+
+	std::vector<uint8_t> frame(source.get_frame_buffer_length());
+
+	for (int32_t mode = ENCODER_MODE_LOW_LATENCY; mode <= ENCODER_MODE_ARCHIVAL; mode++)
+	{
+		const char* name = Encoder::get_mode_name((EncoderMode)mode);
+		int64_t callback_packets = 0;
+
+		Encoder* encoder = new Encoder();
+		encoder->set_width(width);
+		encoder->set_height(height);
+		encoder->set_bytepixel(4);
+		encoder->set_fps(fps);
+		encoder->set_bitrate(1000000);
+		encoder->set_mode((EncoderMode)mode);
+		encoder->set_packet_callback([&](const AVPacket*, int64_t) { callback_packets++; });
+
+		if (!check(encoder->initialize() == 0, "%s : cannot initialize encoder", name))
+		{
+			delete encoder;
+			passed = false;
+			continue;
+		}
+
+		FrameInfo info = {};
+		for (int32_t i = 0; i < ENCODER_TEST_FRAMES; i++)
+		{
+			source.get_frame_data(frame.data(), &info);
+			info.pts = i;
+			info.capture_us = (int64_t)i * 1000000 / fps;
+			info.present_us = -1;
+
+			if (!check(encoder->encode_frame(frame.data(), info) == 0, "%s : encode_frame failed at frame %d", name, i))
+			{
+				passed = false;
+				break;
+			}
+		}
+
+		passed = check(encoder->output_close() == 0, "%s : flush failed", name) && passed;
+		passed = check(encoder->get_submitted_frames() == ENCODER_TEST_FRAMES, "%s : %lld frames submitted for %d",
+			name, (long long)encoder->get_submitted_frames(), ENCODER_TEST_FRAMES) && passed;
+		passed = check(encoder->get_encoded_packets() == ENCODER_TEST_FRAMES, "%s : %lld packets for %d frames",
+			name, (long long)encoder->get_encoded_packets(), ENCODER_TEST_FRAMES) && passed;
+		passed = check(callback_packets == ENCODER_TEST_FRAMES, "%s : %lld packets reached the callback for %d frames",
+			name, (long long)callback_packets, ENCODER_TEST_FRAMES) && passed;
+
+		delete encoder;
+	}
+
+	source.stop_capture();
+
+	return passed;
+}
+
+static void set_region(FrameRegion* region, int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+	region->left = left;
+	region->top = top;
+	region->right = right;
+	region->bottom = bottom;
+}
+
+// fewer regions than the frame before must not leave stale or uninitialized entries for libx264 to read,
+// a zero denominator among them fails the frame
+bool test_encoder_roi_region_count()
+{
+	const int32_t width = 640;
+	const int32_t height = 360;
+	const int32_t fps = 30;
+	const int32_t region_counts[] = { 3, 1, MAX_FRAME_REGIONS, 0, -1, 2 };
+	bool passed = true;
+
+	SyntheticSource source;
+	if (!check(source.initialize(width, height, 1000 / fps) == 0, "cannot initialize synthetic source"))
+	{
+		return false;
+	}
+	source.start_capture();
+
+	std::vector<uint8_t> frame(source.get_frame_buffer_length());
+
+	Encoder* encoder = new Encoder();
+	encoder->set_width(width);
+	encoder->set_height(height);
+	encoder->set_bytepixel(4);
+	encoder->set_fps(fps);
+	encoder->set_bitrate(1000000);
+	encoder->set_roi(true);
+
+	if (!check(encoder->initialize() == 0, "cannot initialize encoder"))
+	{
+		source.stop_capture();
+		delete encoder;
+		return false;
+	}
+
+	FrameInfo info = {};
+	int64_t pts = 0;
+	for (int32_t region_count : region_counts)
+	{
+		source.get_frame_data(frame.data(), &info);
+		info.pts = pts;
+		info.capture_us = pts * 1000000 / fps;
+		info.present_us = -1;
+		info.region_count = region_count;
+		for (int32_t i = 0; i < region_count; i++)
+		{
+			set_region(&info.regions[i], i * 32, i * 16, i * 32 + 64, i * 16 + 64);
+		}
+		info.cursor_visible = region_count == 1;
+		set_region(&info.cursor, 100, 100, 132, 132);
+
+		passed = check(encoder->encode_frame(frame.data(), info) == 0, "encode_frame failed with %d regions", region_count) && passed;
+		pts++;
+
+		// a repeated picture has only the static background entry
+		passed = check(encoder->encode_duplicate(pts) == 0, "encode_duplicate failed after %d regions", region_count) && passed;
+		pts++;
+	}
+
+	passed = check(encoder->output_close() == 0, "flush failed") && passed;
+	passed = check(encoder->get_encoded_packets() == pts, "%lld packets for %lld frames",
+		(long long)encoder->get_encoded_packets(), (long long)pts) && passed;
+
+	delete encoder;
+	source.stop_capture();
+
+	return passed;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// every test returns false once it has printed what failed
+typedef bool (*TestFunction)();
+
+struct TestCase
+{
+	const char* name;
+	TestFunction function;
+};
+
+// prints the failure when condition is false and returns condition
+bool check(bool condition, const char* format, ...);
+
+// encoded, muxed and queued packets of a steady stream of frames reuse their buffers
+bool test_steady_state_allocations();
+// one packet per frame in every encoder mode once the encoder is flushed
+bool test_encoder_packet_count();
+// region of interest side data stays valid when a frame has fewer regions than the one before
+bool test_encoder_roi_region_count();
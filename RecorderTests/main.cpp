@@ -0,0 +1,77 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RecorderApi.h"
+#include "Tests.h"
+
+static const TestCase tests[] =
+{
+	{ "steady_state_allocations", test_steady_state_allocations },
+	{ "encoder_packet_count", test_encoder_packet_count },
+	{ "encoder_roi_region_count", test_encoder_roi_region_count },
+};
+
+static bool verbose = false;
+
+static void on_log(void*, const char* message)
+{
+	if (verbose) fputs(message, stderr);
+}
+
+bool check(bool condition, const char* format, ...)
+{
+	if (!condition)
+	{
+		va_list args;
+		va_start(args, format);
+		fputs("  failed: ", stderr);
+		vfprintf(stderr, format, args);
+		fputs("\n", stderr);
+		va_end(args);
+	}
+
+	return condition;
+}
+
+// usage: RecorderTests [--verbose] [name...], no name runs every test
+int main(int argc, char* argv[])
+{
+	int32_t selected = 0;
+	int32_t ran = 0;
+	int32_t failed = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+		else selected++;
+	}
+
+	recorder_set_log_callback(on_log, nullptr);
+
+	for (const TestCase& test : tests)
+	{
+		bool run = selected == 0;
+		for (int i = 1; i < argc && !run; i++)
+		{
+			run = strcmp(argv[i], test.name) == 0;
+		}
+		if (!run)
+		{
+			continue;
+		}
+
+		ran++;
+		bool passed = test.function();
+		fprintf(stderr, "%-32s %s\n", test.name, passed ? "ok" : "FAILED");
+		if (!passed) failed++;
+	}
+
+	if (ran < selected)
+	{
+		fprintf(stderr, "unknown test name\n");
+		return 2;
+	}
+
+	return failed > 0 ? 1 : 0;
+}